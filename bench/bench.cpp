@@ -0,0 +1,367 @@
+// bench.cpp
+
+// Copyright 2020 Michele Schimd
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <ctl.h>
+#include <str/distance.hpp>
+#include <btl/generator.hpp>
+#include <btl/io.hpp>
+
+#include <script_probability.hpp>
+
+#include "read_sim.hpp"
+
+/// Micro and macro benchmarks of the kernels used by the tools: the
+/// wagner-fischer distance and backtrack of ged and ed-score, the
+/// script probability of edscripts, the error model of read-gen and
+/// the fasta reader and random genome generator of genome-gen. Every
+/// result is written as one JSON object per line (ns/op and, where it
+/// applies, DP cells/s or bytes/s) so that runs can be compared with a
+/// saved baseline.
+
+struct BenchResult
+{
+  std::string name;
+  std::size_t size;
+  std::size_t iterations;
+  double      ns_per_op;
+  // work per operation (0 when it does not apply)
+  double      cells;
+  double      bytes;
+
+  std::string
+  key() const
+  {
+    return name + "/" + std::to_string(size);
+  }
+};
+
+struct BenchOptions
+{
+  std::string json;
+  std::string baseline;
+  std::string filter;
+  double      min_time;
+  std::size_t repeats;
+  double      tolerance;
+  bool        quick;
+
+  /// Arguments are key=value pairs (json, baseline, filter, min_time,
+  /// repeats, tolerance, quick).
+  BenchOptions(int argc, char** argv)
+    : json {""}, baseline {""}, filter {""}, min_time {0.2}, repeats {3},
+      tolerance {0.1}, quick {false}
+  {
+    std::map<std::string, std::string> kv;
+    for (int a = 1; a < argc; ++a) {
+      std::string arg {argv[a]};
+      std::size_t eq = arg.find('=');
+      if (eq == std::string::npos) {
+	std::cerr << "Usage:\n\tbench [json=out.json] [baseline=base.json] "
+		  << "[filter=name] [min_time=0.2] [repeats=3] "
+		  << "[tolerance=0.1] [quick=1]\n";
+	exit(1);
+      }
+      kv[arg.substr(0, eq)] = arg.substr(eq + 1);
+    }
+    auto it_end = kv.end();
+    if (kv.find("json") != it_end) {
+      json = kv["json"];
+    }
+    if (kv.find("baseline") != it_end) {
+      baseline = kv["baseline"];
+    }
+    if (kv.find("filter") != it_end) {
+      filter = kv["filter"];
+    }
+    if (kv.find("min_time") != it_end) {
+      min_time = ctl::from_string<double>(kv["min_time"]);
+    }
+    if (kv.find("repeats") != it_end) {
+      repeats = std::max<std::size_t>(1, ctl::from_string<std::size_t>(kv["repeats"]));
+    }
+    if (kv.find("tolerance") != it_end) {
+      tolerance = ctl::from_string<double>(kv["tolerance"]);
+    }
+    if (kv.find("quick") != it_end) {
+      quick = ctl::from_string<int>(kv["quick"]) != 0;
+    }
+  }
+};
+
+// results of the benchmarked calls end here so that they are not
+// optimized away
+static volatile std::size_t bench_sink = 0;
+
+class BenchRunner
+{
+private:
+  const BenchOptions&      opts;
+  std::vector<BenchResult> results;
+
+  template <typename F_>
+  static double
+  seconds(F_& f, std::size_t iterations)
+  {
+    auto t0 = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < iterations; ++i) {
+      f();
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(t1 - t0).count();
+  }
+
+public:
+  explicit BenchRunner(const BenchOptions& o) : opts(o), results() { }
+
+  bool
+  enabled(const std::string& name) const
+  {
+    return opts.filter.empty() || name.find(opts.filter) != std::string::npos;
+  }
+
+  /// Times f (one operation per call): the number of iterations is
+  /// grown until a run takes min_time, then the best of 'repeats' runs
+  /// is kept.
+  template <typename F_>
+  void
+  run(const std::string& name, std::size_t size, double cells, double bytes,
+      F_ f)
+  {
+    if (!enabled(name)) {
+      return;
+    }
+    f();
+    std::size_t iterations = 1;
+    double t = seconds(f, iterations);
+    while (t < opts.min_time && iterations < (std::size_t(1) << 40)) {
+      iterations *= (t > 0) ? std::max<std::size_t>(
+	2, std::min<std::size_t>(16, static_cast<std::size_t>(opts.min_time / t) + 1)) : 16;
+      t = seconds(f, iterations);
+    }
+    for (std::size_t r = 1; r < opts.repeats; ++r) {
+      t = std::min(t, seconds(f, iterations));
+    }
+    BenchResult res {name, size, iterations, 1e9 * t / iterations, cells, bytes};
+    std::cerr << std::left << std::setw(28) << res.key() << std::right
+	      << std::setw(16) << std::fixed << std::setprecision(1)
+	      << res.ns_per_op << " ns/op";
+    if (cells > 0) {
+      std::cerr << std::setw(12) << std::setprecision(3)
+		<< cells / res.ns_per_op << " Gcells/s";
+    }
+    if (bytes > 0) {
+      std::cerr << std::setw(12) << std::setprecision(1)
+		<< 1e3 * bytes / res.ns_per_op << " MB/s";
+    }
+    std::cerr << "\n";
+    results.push_back(res);
+  }
+
+  const std::vector<BenchResult>& result_list() const { return results; }
+};
+
+void
+write_json(std::ostream& os, const std::vector<BenchResult>& results)
+{
+  os << "{\"benchmarks\": [\n";
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const BenchResult& r = results[i];
+    os << "  {\"name\": \"" << r.name << "\", \"size\": " << r.size
+       << ", \"iterations\": " << r.iterations
+       << std::setprecision(6) << std::scientific
+       << ", \"ns_per_op\": " << r.ns_per_op
+       << ", \"cells_per_s\": " << (r.cells > 0 ? 1e9 * r.cells / r.ns_per_op : 0.0)
+       << ", \"bytes_per_s\": " << (r.bytes > 0 ? 1e9 * r.bytes / r.ns_per_op : 0.0)
+       << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+  }
+  os << "]}\n";
+}
+
+/// Value following "key": in 'line' (empty if missing).
+std::string
+json_field(const std::string& line, const std::string& key)
+{
+  std::size_t p = line.find("\"" + key + "\":");
+  if (p == std::string::npos) {
+    return "";
+  }
+  p += key.size() + 3;
+  while (p < line.size() && (line[p] == ' ' || line[p] == '"')) {
+    ++p;
+  }
+  std::size_t e = p;
+  while (e < line.size() && line[e] != '"' && line[e] != ',' && line[e] != '}') {
+    ++e;
+  }
+  return line.substr(p, e - p);
+}
+
+/// ns/op by benchmark key of a file written by write_json (one
+/// benchmark per line).
+std::map<std::string, double>
+read_baseline(const std::string& path)
+{
+  std::ifstream is {path};
+  if (!is) {
+    std::cerr << "Cannot open baseline " << path << "\n";
+    exit(1);
+  }
+  std::map<std::string, double> base;
+  std::string line;
+  while (std::getline(is, line)) {
+    std::string name = json_field(line, "name");
+    if (!name.empty()) {
+      base[name + "/" + json_field(line, "size")] =
+	ctl::from_string<double>(json_field(line, "ns_per_op"));
+    }
+  }
+  return base;
+}
+
+/// Prints new/baseline times; returns the number of benchmarks slower
+/// than the baseline by more than 'tolerance'.
+std::size_t
+compare(std::ostream& os, const std::vector<BenchResult>& results,
+	const std::map<std::string, double>& base, double tolerance)
+{
+  std::size_t slower = 0;
+  os << "\n" << std::left << std::setw(28) << "benchmark" << std::right
+     << std::setw(14) << "baseline ns" << std::setw(14) << "current ns"
+     << std::setw(10) << "speedup" << "\n";
+  for (const BenchResult& r : results) {
+    auto it = base.find(r.key());
+    os << std::left << std::setw(28) << r.key() << std::right << std::fixed;
+    if (it == base.end()) {
+      os << std::setw(14) << "-" << std::setw(14) << std::setprecision(1)
+	 << r.ns_per_op << std::setw(10) << "new" << "\n";
+      continue;
+    }
+    double speedup = it->second / r.ns_per_op;
+    bool regression = r.ns_per_op > it->second * (1 + tolerance);
+    slower += regression ? 1 : 0;
+    os << std::setw(14) << std::setprecision(1) << it->second
+       << std::setw(14) << r.ns_per_op << std::setw(9) << std::setprecision(2)
+       << speedup << "x" << (regression ? "  SLOWER" : "") << "\n";
+  }
+  return slower;
+}
+
+int
+main(int argc, char** argv)
+{
+  BenchOptions opts(argc, argv);
+  BenchRunner bench(opts);
+  std::mt19937 rdev {2020};
+  const std::vector<double> acgt {0.25, 0.25, 0.25, 0.25};
+  auto random_string = [&](std::size_t n) {
+    return btl::random_genome_string(n, acgt, rdev);
+  };
+
+  // wagner-fischer DP, distance and backtrack (ged, ed-score)
+  std::vector<std::size_t> wf_sizes {64, 256, 1024};
+  if (!opts.quick) {
+    wf_sizes.push_back(4096);
+  }
+  for (std::size_t m : wf_sizes) {
+    std::string x = random_string(m);
+    std::string y = random_string(m);
+    auto ed = ctl::make_wf_alg(m, m);
+    double cells = static_cast<double>(m) * m;
+    bench.run("wf_distance", m, cells, 0, [&]() {
+	bench_sink += static_cast<std::size_t>(ed(x, y));
+      });
+    if (m <= 1024 && bench.enabled("wf_backtrack")) {
+      using ListPair = std::list<std::pair<std::size_t, std::size_t>>;
+      ed(x, y);
+      bench.run("wf_backtrack", m, 0, 0, [&]() {
+	  bench_sink += ed.backtrack<ListPair>().size();
+	});
+    }
+  }
+
+  // probability of all the edit scripts (edscripts, ed-dist)
+  const std::vector<double> ps {0.9, 0.05, 0.025, 0.025};
+  for (std::size_t m : {16, 64, 256, 1024}) {
+    std::string x = random_string(m);
+    std::string y = random_string(m);
+    ScriptProbability sp(ps);
+    bench.run("ed_scripts_probability", m, static_cast<double>(m) * m, 0, [&]() {
+	bench_sink += static_cast<std::size_t>(sp.log_probability(x, y) < 0);
+      });
+  }
+
+  // error model applied to reads (read-gen)
+  for (std::size_t L : {100, 1000, 10000}) {
+    std::string r = random_string(L);
+    ErrorModel model({0.01, 0.005, 0.005});
+    std::mt19937_64 rd64 {2020};
+    std::string out;
+    bench.run("edit_error", L, 0, static_cast<double>(L), [&]() {
+	out.clear();
+	model.apply(r.begin(), r.end(), out, rd64);
+	bench_sink += out.size();
+      });
+  }
+
+  // genome generation and fasta loading (genome-gen, ged, read-gen)
+  std::vector<std::size_t> genome_sizes {std::size_t(1) << 20};
+  if (!opts.quick) {
+    genome_sizes.push_back(std::size_t(1) << 24);
+  }
+  for (std::size_t G : genome_sizes) {
+    bench.run("random_genome_string", G, 0, static_cast<double>(G), [&]() {
+	bench_sink += random_string(G).size();
+      });
+    if (bench.enabled("read_fasta")) {
+      const std::string path {"bench_genome.fa"};
+      {
+	std::ofstream os {path};
+	btl::write_fasta(os, random_string(G) + "\n", "> bench");
+      }
+      bench.run("read_fasta", G, 0, static_cast<double>(G), [&]() {
+	  bench_sink += btl::read_fasta(path).second.size();
+	});
+      std::remove(path.c_str());
+    }
+  }
+
+  if (opts.json.empty()) {
+    write_json(std::cout, bench.result_list());
+  } else {
+    std::ofstream os {opts.json};
+    write_json(os, bench.result_list());
+  }
+  if (!opts.baseline.empty()) {
+    std::size_t slower = compare(std::cerr, bench.result_list(),
+				 read_baseline(opts.baseline), opts.tolerance);
+    return (slower > 0) ? 2 : 0;
+  }
+  return 0;
+}
@@ -0,0 +1,119 @@
+// banded_ed.hpp
+
+// Copyright 2020 Michele Schimd
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RES_SW_BANDED_ED_HPP
+#define RES_SW_BANDED_ED_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <vector>
+
+/// Value used to disable the threshold.
+constexpr std::size_t NoThreshold = std::numeric_limits<std::size_t>::max();
+
+/// Thresholded edit distance (Ukkonen 1985). Only the diagonals
+/// |j-i| <= k of the Wagner-Fischer matrix are computed, which costs
+/// O(k*n) instead of O(n*m). The result is the exact distance when it
+/// is at most k, otherwise k+1 is returned (the pair is 'censored').
+/// The computation stops as soon as a whole row of the band exceeds
+/// k, since the distance can only grow from there.
+class BandedED
+{
+private:
+  std::size_t              k;
+  std::vector<std::size_t> prev;
+  std::vector<std::size_t> cur;
+  // band cells computed since the last reset_cells()
+  std::uint64_t            cells;
+
+public:
+  explicit BandedED(std::size_t k_)
+    : k(k_), prev(2*k_+1), cur(2*k_+1), cells(0) { }
+
+  std::size_t threshold() const { return k; }
+
+  /// DP cells computed by the calls since the last reset_cells() (2k+1
+  /// per row evaluated, rows after an early stop are not counted).
+  std::uint64_t computed_cells() const { return cells; }
+
+  void reset_cells() { cells = 0; }
+
+  bool censored(std::size_t d) const { return d > k; }
+
+  template <typename It_>
+  std::size_t
+  distance(It_ xb, It_ xe, It_ yb, It_ ye)
+  {
+    const std::size_t censor = k + 1;
+    const long n = static_cast<long>(xe - xb);
+    const long m = static_cast<long>(ye - yb);
+    const long K = static_cast<long>(k);
+    if (std::abs(n - m) > K) {
+      return censor;
+    }
+    // band index d corresponds to column j = i + d - k
+    for (long d = 0; d <= 2*K; ++d) {
+      long j = d - K;
+      prev[d] = (j >= 0 && j <= m) ? static_cast<std::size_t>(j) : censor;
+    }
+    for (long i = 1; i <= n; ++i) {
+      std::size_t row_min = censor;
+      auto xi = *(xb + (i-1));
+      for (long d = 0; d <= 2*K; ++d) {
+	long j = i + d - K;
+	std::size_t v = censor;
+	if (j == 0) {
+	  v = static_cast<std::size_t>(i);
+	} else if (j > 0 && j <= m) {
+	  v = prev[d] + ((xi == *(yb + (j-1))) ? 0 : 1);
+	  if (d + 1 <= 2*K) {
+	    v = std::min(v, prev[d+1] + 1);
+	  }
+	  if (d > 0) {
+	    v = std::min(v, cur[d-1] + 1);
+	  }
+	}
+	cur[d] = std::min(v, censor);
+	row_min = std::min(row_min, cur[d]);
+      }
+      cells += static_cast<std::uint64_t>(2*K + 1);
+      if (row_min > k) {
+	return censor;
+      }
+      std::swap(prev, cur);
+    }
+    return prev[m - n + K];
+  }
+
+  /// Same calling convention of the algorithms returned by
+  /// ctl::make_wf_alg.
+  std::size_t
+  operator()(const std::string& x, const std::string& y)
+  {
+    return distance(x.begin(), x.end(), y.begin(), y.end());
+  }
+};
+
+inline BandedED
+make_banded_alg(std::size_t k)
+{
+  return BandedED(k);
+}
+
+#endif
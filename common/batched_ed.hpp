@@ -0,0 +1,150 @@
+// batched_ed.hpp
+
+// Copyright 2020 Michele Schimd
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RES_SW_BATCHED_ED_HPP
+#define RES_SW_BATCHED_ED_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+/// Inter-pair (lane parallel) edit distance. Up to EDBatchLanes
+/// independent pairs, all with |x|=n and |y|=m, are evaluated
+/// together: symbols are stored interleaved (lane fastest) so the
+/// inner loop of the Wagner-Fischer recurrence runs over the lanes and
+/// is vectorized by the compiler. With GCC/clang on x86-64 the kernel
+/// is compiled for SSE4.1, AVX2 and AVX-512BW and the best version is
+/// selected at run time (target_clones), so 8, 16 or 32 cells of 16
+/// bits are updated by each instruction.
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define RES_SW_TARGET_CLONES \
+  __attribute__((target_clones("arch=skylake-avx512", "avx2", "sse4.1", \
+				"default")))
+#else
+#define RES_SW_TARGET_CLONES
+#endif
+
+constexpr std::size_t EDBatchLanes = 32;
+
+/// Computes the distances of a full batch. 'xs' is n*Lanes symbols
+/// (xs[i*Lanes + l] = i-th symbol of x in lane l), 'ys' is m*Lanes,
+/// 'row' is scratch space for (m+1)*Lanes cells.
+RES_SW_TARGET_CLONES
+static void
+batched_ed_kernel(const std::uint8_t* xs, const std::uint8_t* ys,
+		  std::size_t n, std::size_t m, std::uint16_t* row,
+		  std::uint16_t* out)
+{
+  const std::size_t L = EDBatchLanes;
+  std::uint16_t diag[EDBatchLanes];
+  for (std::size_t j = 0; j <= m; ++j) {
+    for (std::size_t l = 0; l < L; ++l) {
+      row[j*L + l] = static_cast<std::uint16_t>(j);
+    }
+  }
+  for (std::size_t i = 1; i <= n; ++i) {
+    const std::uint8_t* xi = xs + (i-1)*L;
+    for (std::size_t l = 0; l < L; ++l) {
+      diag[l] = row[l];
+      row[l] = static_cast<std::uint16_t>(i);
+    }
+    for (std::size_t j = 1; j <= m; ++j) {
+      const std::uint8_t* yj = ys + (j-1)*L;
+      std::uint16_t* cur = row + j*L;
+      const std::uint16_t* left = row + (j-1)*L;
+      for (std::size_t l = 0; l < L; ++l) {
+	std::uint16_t up = cur[l];
+	std::uint16_t sub = diag[l] + (xi[l] != yj[l] ? 1 : 0);
+	std::uint16_t gap = (up < left[l] ? up : left[l]) + 1;
+	diag[l] = up;
+	cur[l] = sub < gap ? sub : gap;
+      }
+    }
+  }
+  for (std::size_t l = 0; l < L; ++l) {
+    out[l] = row[m*L + l];
+  }
+}
+
+class BatchedED
+{
+private:
+  std::size_t n;
+  std::size_t m;
+  std::size_t count;
+  std::vector<std::uint8_t>  xs;
+  std::vector<std::uint8_t>  ys;
+  std::vector<std::uint16_t> row;
+  std::vector<std::uint16_t> dist;
+
+public:
+  BatchedED(std::size_t n_, std::size_t m_)
+    : n(n_), m(m_), count(0), xs(n_*EDBatchLanes), ys(m_*EDBatchLanes),
+      row((m_+1)*EDBatchLanes), dist(EDBatchLanes)
+  {
+    // cells are 16 bits wide
+    if (n + m >= 0xFFFF) {
+      throw std::invalid_argument("BatchedED: sequences too long");
+    }
+  }
+
+  static constexpr std::size_t lanes() { return EDBatchLanes; }
+
+  std::size_t size() const { return count; }
+  bool full() const { return count == EDBatchLanes; }
+  void clear() { count = 0; }
+
+  /// Adds the pair ([xb,xb+n), [yb,yb+m)) to the batch.
+  template <typename It_>
+  void
+  add(It_ xb, It_ yb)
+  {
+    for (std::size_t i = 0; i < n; ++i, ++xb) {
+      xs[i*EDBatchLanes + count] = static_cast<std::uint8_t>(*xb);
+    }
+    for (std::size_t j = 0; j < m; ++j, ++yb) {
+      ys[j*EDBatchLanes + count] = static_cast<std::uint8_t>(*yb);
+    }
+    ++count;
+  }
+
+  /// Computes the distances of the pairs added so far, the i-th
+  /// distance is returned by distance(i). Unused lanes are computed
+  /// on stale symbols and ignored.
+  void
+  compute()
+  {
+    batched_ed_kernel(xs.data(), ys.data(), n, m, row.data(), dist.data());
+  }
+
+  std::size_t distance(std::size_t i) const { return dist[i]; }
+
+  /// Single pair evaluation (same convention as ctl::make_wf_alg),
+  /// mostly useful for checking against the other algorithms.
+  std::size_t
+  operator()(const std::string& x, const std::string& y)
+  {
+    clear();
+    add(x.begin(), y.begin());
+    compute();
+    clear();
+    return distance(0);
+  }
+};
+
+#endif
@@ -0,0 +1,188 @@
+// bit_parallel_ed.hpp
+
+// Copyright 2020 Michele Schimd
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RES_SW_BIT_PARALLEL_ED_HPP
+#define RES_SW_BIT_PARALLEL_ED_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/// Bit-parallel (Myers 1999, blocked version by Hyyro 2003) global
+/// edit distance. The pattern x is encoded one bit per symbol in
+/// words of 64 bits, each text symbol updates a whole column of the
+/// Wagner-Fischer matrix with a few word operations per block. The
+/// result is exactly the unit-cost edit distance returned by
+/// ctl::make_wf_alg, but the matrix is never stored.
+///
+/// Patterns up to 64 symbols use a single-word loop, longer patterns
+/// use ceil(m/64) blocks.
+///
+/// The pattern can be set once with set_pattern() and then compared
+/// against many texts with distance(), which is what repeated
+/// evaluations against the same x should use.
+class BitParallelED
+{
+private:
+
+  using Word = std::uint64_t;
+  static constexpr std::size_t WordBits = 64;
+  static constexpr std::size_t Sigma = 256;
+
+  std::size_t       m;
+  std::size_t       W;
+  // peq[c*W + b] has bit i set iff x[b*64+i] == c
+  std::vector<Word> peq;
+  std::vector<Word> pv;
+  std::vector<Word> mv;
+  // distinct symbols of the current pattern (used to reset peq)
+  std::string       used;
+  Word              last_bit;
+
+  void
+  reserve(std::size_t words)
+  {
+    if (words > W) {
+      W = words;
+      peq.assign(Sigma * W, 0);
+      pv.resize(W);
+      mv.resize(W);
+      used.clear();
+    }
+  }
+
+  // Advances one block by one text symbol; 'hin' is the horizontal
+  // delta entering from above (-1, 0, +1), returns the delta leaving
+  // through the row selected by 'out_bit'.
+  static int
+  advance_block(Word& Pv, Word& Mv, Word Eq, int hin, Word out_bit)
+  {
+    Word hin_neg = (hin < 0) ? 1 : 0;
+    Word Xv = Eq | Mv;
+    Eq |= hin_neg;
+    Word Xh = (((Eq & Pv) + Pv) ^ Pv) | Eq;
+    Word Ph = Mv | ~(Xh | Pv);
+    Word Mh = Pv & Xh;
+    int hout = 0;
+    if (Ph & out_bit) {
+      hout = 1;
+    } else if (Mh & out_bit) {
+      hout = -1;
+    }
+    Ph <<= 1;
+    Mh <<= 1;
+    Mh |= hin_neg;
+    Ph |= (hin > 0) ? 1 : 0;
+    Pv = Mh | ~(Xv | Ph);
+    Mv = Ph & Xv;
+    return hout;
+  }
+
+public:
+
+  explicit BitParallelED(std::size_t max_m = WordBits)
+    : m(0), W(0), peq(), pv(), mv(), used(), last_bit(0)
+  {
+    reserve((max_m + WordBits - 1) / WordBits);
+  }
+
+  template <typename It_>
+  void
+  set_pattern(It_ b, It_ e)
+  {
+    for (unsigned char c : used) {
+      std::fill(peq.begin() + c*W, peq.begin() + (c+1)*W, 0);
+    }
+    used.clear();
+    m = static_cast<std::size_t>(e - b);
+    reserve((m + WordBits - 1) / WordBits);
+    for (std::size_t i = 0; b != e; ++b, ++i) {
+      unsigned char c = static_cast<unsigned char>(*b);
+      Word* row = &peq[c*W];
+      if (used.find(static_cast<char>(c)) == std::string::npos) {
+	used.push_back(static_cast<char>(c));
+      }
+      row[i / WordBits] |= Word(1) << (i % WordBits);
+    }
+    last_bit = (m > 0) ? Word(1) << ((m - 1) % WordBits) : 0;
+  }
+
+  void
+  set_pattern(const std::string& x) { set_pattern(x.begin(), x.end()); }
+
+  std::size_t
+  pattern_size() const { return m; }
+
+  /// Edit distance between the current pattern and [b,e).
+  template <typename It_>
+  std::size_t
+  distance(It_ b, It_ e)
+  {
+    if (m == 0) {
+      return static_cast<std::size_t>(e - b);
+    }
+    std::size_t score = m;
+    if (m <= WordBits) {
+      // single word fast path
+      Word Pv = ~Word(0);
+      Word Mv = 0;
+      for (; b != e; ++b) {
+	Word Eq = peq[static_cast<unsigned char>(*b) * W];
+	score += advance_block(Pv, Mv, Eq, 1, last_bit);
+      }
+      return score;
+    }
+    std::size_t blocks = (m + WordBits - 1) / WordBits;
+    const Word high_bit = Word(1) << (WordBits - 1);
+    std::fill(pv.begin(), pv.begin() + blocks, ~Word(0));
+    std::fill(mv.begin(), mv.begin() + blocks, 0);
+    for (; b != e; ++b) {
+      const Word* eq = &peq[static_cast<unsigned char>(*b) * W];
+      // first row of the matrix increases by one at each column
+      int h = 1;
+      for (std::size_t k = 0; k + 1 < blocks; ++k) {
+	h = advance_block(pv[k], mv[k], eq[k], h, high_bit);
+      }
+      score += advance_block(pv[blocks-1], mv[blocks-1], eq[blocks-1], h,
+			     last_bit);
+    }
+    return score;
+  }
+
+  std::size_t
+  distance(const std::string& y) { return distance(y.begin(), y.end()); }
+
+  /// Same calling convention of the algorithms returned by
+  /// ctl::make_wf_alg.
+  std::size_t
+  operator()(const std::string& x, const std::string& y)
+  {
+    set_pattern(x);
+    return distance(y);
+  }
+};
+
+/// Makes a bit-parallel edit distance algorithm for patterns of
+/// length (up to) m, the second argument is only for compatibility
+/// with ctl::make_wf_alg.
+inline BitParallelED
+make_bit_parallel_alg(std::size_t m, std::size_t = 0)
+{
+  return BitParallelED(m);
+}
+
+#endif
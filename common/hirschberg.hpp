@@ -0,0 +1,244 @@
+// hirschberg.hpp
+
+// Copyright 2020 Michele Schimd
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RES_SW_HIRSCHBERG_HPP
+#define RES_SW_HIRSCHBERG_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// Run of identical alignment operations, in extended CIGAR notation:
+/// '=' match, 'X' substitution, 'D' symbol of x deleted, 'I' symbol
+/// of y inserted.
+struct EditOp
+{
+  char        op;
+  std::size_t len;
+};
+
+using Cigar = std::vector<EditOp>;
+
+inline std::string
+cigar_string(const Cigar& cigar)
+{
+  std::string s;
+  for (const EditOp& e : cigar) {
+    s += std::to_string(e.len);
+    s.push_back(e.op);
+  }
+  return s;
+}
+
+/// Renders the alignment of x and y described by 'cigar', gaps are
+/// written as 'gap'.
+inline std::pair<std::string, std::string>
+render_alignment(const std::string& x, const std::string& y,
+		 const Cigar& cigar, char gap = '-')
+{
+  std::string xa, ya;
+  std::size_t len = 0;
+  for (const EditOp& e : cigar) {
+    len += e.len;
+  }
+  xa.reserve(len);
+  ya.reserve(len);
+  std::size_t i = 0;
+  std::size_t j = 0;
+  for (const EditOp& e : cigar) {
+    bool in_x = (e.op != 'I');
+    bool in_y = (e.op != 'D');
+    xa.append(in_x ? x.substr(i, e.len) : std::string(e.len, gap));
+    ya.append(in_y ? y.substr(j, e.len) : std::string(e.len, gap));
+    i += in_x ? e.len : 0;
+    j += in_y ? e.len : 0;
+  }
+  return std::make_pair(xa, ya);
+}
+
+/// Optimal (edit distance) alignment in O(n+m) memory with Hirschberg's
+/// divide and conquer: the middle row of x is matched to the column
+/// of y minimizing forward plus reverse distance, then both halves are
+/// aligned recursively. Time is about twice the plain DP; subproblems
+/// smaller than BaseCells are solved with the full matrix. An instance
+/// reuses its buffers between calls.
+class HirschbergAligner
+{
+public:
+  static constexpr std::size_t BaseCells = 1 << 14;
+
+private:
+  std::vector<std::size_t> fwd;
+  std::vector<std::size_t> rev;
+  std::vector<std::size_t> base;
+  Cigar*                   out;
+
+  void
+  push(char op, std::size_t len)
+  {
+    if (len == 0) {
+      return;
+    }
+    if (!out->empty() && out->back().op == op) {
+      out->back().len += len;
+    } else {
+      out->push_back(EditOp{op, len});
+    }
+  }
+
+  /// Last row of the DP of x[0,n) and y[0,m) in 'row'.
+  static void
+  forward_row(const char* x, std::size_t n, const char* y, std::size_t m,
+	      std::vector<std::size_t>& row)
+  {
+    row.resize(m+1);
+    for (std::size_t j = 0; j < m+1; ++j) {
+      row[j] = j;
+    }
+    for (std::size_t i = 1; i < n+1; ++i) {
+      std::size_t diag = row[0];
+      row[0] = i;
+      for (std::size_t j = 1; j < m+1; ++j) {
+	std::size_t up = row[j];
+	row[j] = std::min({up + 1, row[j-1] + 1,
+	      diag + (x[i-1] == y[j-1] ? 0 : 1)});
+	diag = up;
+      }
+    }
+  }
+
+  /// row[j] = ED(x[0,n), y[m-j,m)), the DP on the reversed strings.
+  static void
+  reverse_row(const char* x, std::size_t n, const char* y, std::size_t m,
+	      std::vector<std::size_t>& row)
+  {
+    row.resize(m+1);
+    for (std::size_t j = 0; j < m+1; ++j) {
+      row[j] = j;
+    }
+    for (std::size_t i = 1; i < n+1; ++i) {
+      std::size_t diag = row[0];
+      row[0] = i;
+      for (std::size_t j = 1; j < m+1; ++j) {
+	std::size_t up = row[j];
+	row[j] = std::min({up + 1, row[j-1] + 1,
+	      diag + (x[n-i] == y[m-j] ? 0 : 1)});
+	diag = up;
+      }
+    }
+  }
+
+  /// Full matrix DP with backtracking for small subproblems.
+  void
+  align_base(const char* x, std::size_t n, const char* y, std::size_t m)
+  {
+    const std::size_t w = m+1;
+    base.resize((n+1)*w);
+    for (std::size_t j = 0; j < m+1; ++j) {
+      base[j] = j;
+    }
+    for (std::size_t i = 1; i < n+1; ++i) {
+      base[i*w] = i;
+      for (std::size_t j = 1; j < m+1; ++j) {
+	base[i*w+j] = std::min({base[(i-1)*w+j] + 1, base[i*w+j-1] + 1,
+	      base[(i-1)*w+j-1] + (x[i-1] == y[j-1] ? 0 : 1)});
+      }
+    }
+    // backtrack from (n,m), operations are collected in reverse
+    std::string ops;
+    std::size_t i = n;
+    std::size_t j = m;
+    while (i > 0 || j > 0) {
+      std::size_t d = base[i*w+j];
+      if (i > 0 && j > 0 &&
+	  d == base[(i-1)*w+j-1] + (x[i-1] == y[j-1] ? 0 : 1)) {
+	ops.push_back(x[i-1] == y[j-1] ? '=' : 'X');
+	--i;
+	--j;
+      } else if (i > 0 && d == base[(i-1)*w+j] + 1) {
+	ops.push_back('D');
+	--i;
+      } else {
+	ops.push_back('I');
+	--j;
+      }
+    }
+    for (std::size_t k = ops.size(); k-- > 0; ) {
+      push(ops[k], 1);
+    }
+  }
+
+  void
+  align_rec(const char* x, std::size_t n, const char* y, std::size_t m)
+  {
+    if (n == 0) {
+      push('I', m);
+      return;
+    }
+    if (m == 0) {
+      push('D', n);
+      return;
+    }
+    if (n == 1 || (n+1)*(m+1) <= BaseCells) {
+      align_base(x, n, y, m);
+      return;
+    }
+    std::size_t mid = n / 2;
+    forward_row(x, mid, y, m, fwd);
+    reverse_row(x + mid, n - mid, y, m, rev);
+    std::size_t split = 0;
+    std::size_t best = fwd[0] + rev[m];
+    for (std::size_t j = 1; j < m+1; ++j) {
+      if (fwd[j] + rev[m-j] < best) {
+	best = fwd[j] + rev[m-j];
+	split = j;
+      }
+    }
+    align_rec(x, mid, y, split);
+    align_rec(x + mid, n - mid, y + split, m - split);
+  }
+
+public:
+  HirschbergAligner() : fwd(), rev(), base(), out(nullptr) { }
+
+  /// Aligns x and y, writes the alignment in 'cigar' and returns the
+  /// edit distance.
+  std::size_t
+  operator()(const std::string& x, const std::string& y, Cigar& cigar)
+  {
+    cigar.clear();
+    out = &cigar;
+    align_rec(x.data(), x.size(), y.data(), y.size());
+    out = nullptr;
+    std::size_t d = 0;
+    for (const EditOp& e : cigar) {
+      d += (e.op == '=') ? 0 : e.len;
+    }
+    return d;
+  }
+
+  Cigar
+  operator()(const std::string& x, const std::string& y)
+  {
+    Cigar cigar;
+    (*this)(x, y, cigar);
+    return cigar;
+  }
+};
+
+#endif
@@ -0,0 +1,415 @@
+// packed_genome.hpp
+
+// Copyright 2020 Michele Schimd
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RES_SW_PACKED_GENOME_HPP
+#define RES_SW_PACKED_GENOME_HPP
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/// Genome stored with 2 bits per base (A=0, C=1, G=2, T=3, four bases
+/// per byte, first base in the lowest bits). Any other symbol is
+/// stored as A and recorded in the N-mask, a sorted list of
+/// (start, length) intervals that read back as 'N'. Lower case bases
+/// are read back upper case.
+///
+/// A packed genome is either built in memory from a string or mapped
+/// (mmap) from a file written with save(), in which case loading is
+/// independent of the genome size and pages are shared between
+/// processes. The file layout (host byte order) is
+///
+///   char[4]  magic "RS2B"
+///   uint32   version
+///   uint64   number of bases
+///   uint64   number of N-mask intervals
+///   uint64   length of the fasta header
+///   char[]   fasta header, zero padded to a multiple of 8 bytes
+///   uint64[] N-mask intervals (start, length)
+///   uint8[]  packed bases
+///
+/// The class provides random access iterators returning bases by
+/// value, so it can be used in place of the std::string genome by
+/// code that only uses begin(), end() and size().
+class PackedGenome
+{
+private:
+  static constexpr std::uint32_t Version = 1;
+  static constexpr std::size_t   HeaderBytes = 32;
+
+  // only used for genomes built in memory
+  std::vector<std::uint8_t>  owned_bases;
+  std::vector<std::uint64_t> owned_mask;
+  // only used for mapped genomes
+  void*                      map_addr;
+  std::size_t                map_len;
+
+  const std::uint8_t*        bases;
+  const std::uint64_t*       mask;
+  std::size_t                n_mask;
+  std::size_t                length;
+  std::string                fasta_header;
+
+  static std::uint8_t
+  encode(char c)
+  {
+    switch (c) {
+    case 'A': case 'a': return 0;
+    case 'C': case 'c': return 1;
+    case 'G': case 'g': return 2;
+    case 'T': case 't': return 3;
+    default: return 4;
+    }
+  }
+
+  /// Index of the first N-mask interval ending after i (n_mask if
+  /// there is none).
+  std::size_t
+  interval_after(std::size_t i) const
+  {
+    std::size_t lo = 0;
+    std::size_t hi = n_mask;
+    while (lo < hi) {
+      std::size_t mid = (lo + hi) / 2;
+      if (mask[2*mid] + mask[2*mid+1] <= i) {
+	lo = mid + 1;
+      } else {
+	hi = mid;
+      }
+    }
+    return lo;
+  }
+
+  char
+  base(std::size_t i) const
+  {
+    return "ACGT"[(bases[i / 4] >> (2 * (i % 4))) & 3];
+  }
+
+  void
+  release()
+  {
+    if (map_addr != nullptr) {
+      munmap(map_addr, map_len);
+      map_addr = nullptr;
+    }
+  }
+
+public:
+
+  /// Keeps the N-mask interval of its position, so that sequential
+  /// access (++, --) does not search the mask; jumps search it once.
+  class const_iterator
+  {
+  private:
+    const PackedGenome* g;
+    std::size_t         i;
+    // first N-mask interval ending after i
+    std::size_t         k;
+
+    bool
+    ends_before(std::size_t j, std::size_t pos) const
+    {
+      return g->mask[2*j] + g->mask[2*j+1] <= pos;
+    }
+
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = char;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const char*;
+    using reference = char;
+
+    const_iterator() : g(nullptr), i(0), k(0) { }
+    const_iterator(const PackedGenome* g_, std::size_t i_)
+      : g(g_), i(i_), k(g_->interval_after(i_)) { }
+
+    char
+    operator*() const
+    {
+      return (k < g->n_mask && g->mask[2*k] <= i) ? 'N' : g->base(i);
+    }
+
+    char operator[](difference_type d) const { return g->at(i + d); }
+
+    const_iterator&
+    operator++()
+    {
+      ++i;
+      while (k < g->n_mask && ends_before(k, i)) {
+	++k;
+      }
+      return *this;
+    }
+
+    const_iterator&
+    operator--()
+    {
+      --i;
+      while (k > 0 && !ends_before(k-1, i)) {
+	--k;
+      }
+      return *this;
+    }
+
+    const_iterator operator++(int) { const_iterator t(*this); ++*this; return t; }
+    const_iterator operator--(int) { const_iterator t(*this); --*this; return t; }
+    const_iterator& operator+=(difference_type d) { return *this = *this + d; }
+    const_iterator& operator-=(difference_type d) { return *this = *this - d; }
+    const_iterator operator+(difference_type d) const {
+      return const_iterator(g, i + d);
+    }
+    const_iterator operator-(difference_type d) const {
+      return const_iterator(g, i - d);
+    }
+    difference_type operator-(const const_iterator& o) const {
+      return static_cast<difference_type>(i) - static_cast<difference_type>(o.i);
+    }
+    bool operator==(const const_iterator& o) const { return i == o.i; }
+    bool operator!=(const const_iterator& o) const { return i != o.i; }
+    bool operator<(const const_iterator& o) const { return i < o.i; }
+    bool operator>(const const_iterator& o) const { return i > o.i; }
+    bool operator<=(const const_iterator& o) const { return i <= o.i; }
+    bool operator>=(const const_iterator& o) const { return i >= o.i; }
+  };
+
+  PackedGenome()
+    : owned_bases(), owned_mask(), map_addr(nullptr), map_len(0),
+      bases(nullptr), mask(nullptr), n_mask(0), length(0), fasta_header()
+  { }
+
+  PackedGenome(const PackedGenome&) = delete;
+  PackedGenome& operator=(const PackedGenome&) = delete;
+
+  PackedGenome(PackedGenome&& o)
+    : PackedGenome()
+  {
+    *this = std::move(o);
+  }
+
+  PackedGenome&
+  operator=(PackedGenome&& o)
+  {
+    release();
+    bool own = (o.map_addr == nullptr);
+    owned_bases = std::move(o.owned_bases);
+    owned_mask = std::move(o.owned_mask);
+    map_addr = o.map_addr;
+    map_len = o.map_len;
+    bases = own ? owned_bases.data() : o.bases;
+    mask = own ? owned_mask.data() : o.mask;
+    n_mask = o.n_mask;
+    length = o.length;
+    fasta_header = std::move(o.fasta_header);
+    o.map_addr = nullptr;
+    o.bases = nullptr;
+    o.mask = nullptr;
+    o.n_mask = 0;
+    o.length = 0;
+    return *this;
+  }
+
+  ~PackedGenome() { release(); }
+
+  /// Packs the sequence 'seq' (with fasta header 'header') in memory.
+  template <typename It_>
+  static PackedGenome
+  from_sequence(It_ b, It_ e, const std::string& header = "")
+  {
+    PackedGenome g;
+    std::size_t n = static_cast<std::size_t>(e - b);
+    g.owned_bases.assign((n + 3) / 4, 0);
+    for (std::size_t i = 0; b != e; ++b, ++i) {
+      std::uint8_t c = encode(*b);
+      if (c > 3) {
+	std::size_t k = g.owned_mask.size();
+	if (k > 0 && g.owned_mask[k-2] + g.owned_mask[k-1] == i) {
+	  g.owned_mask[k-1]++;
+	} else {
+	  g.owned_mask.push_back(i);
+	  g.owned_mask.push_back(1);
+	}
+	c = 0;
+      }
+      g.owned_bases[i / 4] |= c << (2 * (i % 4));
+    }
+    g.bases = g.owned_bases.data();
+    g.mask = g.owned_mask.data();
+    g.n_mask = g.owned_mask.size() / 2;
+    g.length = n;
+    g.fasta_header = header;
+    return g;
+  }
+
+  static PackedGenome
+  from_string(const std::string& seq, const std::string& header = "")
+  {
+    return from_sequence(seq.begin(), seq.end(), header);
+  }
+
+  /// Maps a file written by save(), throws std::runtime_error if the
+  /// file cannot be mapped or is not a packed genome.
+  static PackedGenome
+  map_file(const std::string& path)
+  {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("Cannot open " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+	static_cast<std::size_t>(st.st_size) < HeaderBytes) {
+      close(fd);
+      throw std::runtime_error("Invalid packed genome " + path);
+    }
+    std::size_t len = static_cast<std::size_t>(st.st_size);
+    void* addr = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+      throw std::runtime_error("Cannot map " + path);
+    }
+    PackedGenome g;
+    g.map_addr = addr;
+    g.map_len = len;
+    const char* p = static_cast<const char*>(addr);
+    std::uint32_t version;
+    std::uint64_t n, nm, hl;
+    std::memcpy(&version, p + 4, 4);
+    std::memcpy(&n, p + 8, 8);
+    std::memcpy(&nm, p + 16, 8);
+    std::memcpy(&hl, p + 24, 8);
+    std::size_t hl_pad = (hl + 7) / 8 * 8;
+    if (std::memcmp(p, "RS2B", 4) != 0 || version != Version ||
+	HeaderBytes + hl_pad + 16*nm + (n + 3) / 4 > len) {
+      throw std::runtime_error("Invalid packed genome " + path);
+    }
+    g.fasta_header.assign(p + HeaderBytes, hl);
+    g.mask = reinterpret_cast<const std::uint64_t*>(p + HeaderBytes + hl_pad);
+    g.n_mask = nm;
+    g.bases = reinterpret_cast<const std::uint8_t*>(p + HeaderBytes + hl_pad
+						     + 16*nm);
+    g.length = n;
+    return g;
+  }
+
+  /// Writes the genome in the format read by map_file().
+  void
+  save(const std::string& path) const
+  {
+    std::ofstream os(path, std::ios::binary);
+    std::uint32_t version = Version;
+    std::uint64_t n = length, nm = n_mask, hl = fasta_header.size();
+    os.write("RS2B", 4);
+    os.write(reinterpret_cast<const char*>(&version), 4);
+    os.write(reinterpret_cast<const char*>(&n), 8);
+    os.write(reinterpret_cast<const char*>(&nm), 8);
+    os.write(reinterpret_cast<const char*>(&hl), 8);
+    os.write(fasta_header.data(), hl);
+    std::string pad((8 - hl % 8) % 8, '\0');
+    os.write(pad.data(), pad.size());
+    os.write(reinterpret_cast<const char*>(mask), 16 * n_mask);
+    os.write(reinterpret_cast<const char*>(bases), (length + 3) / 4);
+    if (!os) {
+      throw std::runtime_error("Cannot write " + path);
+    }
+  }
+
+  std::size_t size() const { return length; }
+
+  const std::string& header() const { return fasta_header; }
+
+  std::size_t masked_intervals() const { return n_mask; }
+
+  char
+  at(std::size_t i) const
+  {
+    if (n_mask > 0) {
+      std::size_t k = interval_after(i);
+      if (k < n_mask && mask[2*k] <= i) {
+	return 'N';
+      }
+    }
+    return base(i);
+  }
+
+  char operator[](std::size_t i) const { return at(i); }
+
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, length); }
+
+  /// Copies bases [pos, pos+len) to 'out' (bulk version of at()).
+  void
+  extract(std::size_t pos, std::size_t len, char* out) const
+  {
+    for (std::size_t i = 0; i < len; ++i) {
+      out[i] = base(pos + i);
+    }
+    if (n_mask == 0) {
+      return;
+    }
+    // first interval that may overlap [pos, pos+len)
+    std::size_t k = interval_after(pos);
+    for (; k < n_mask && mask[2*k] < pos + len; ++k) {
+      std::size_t b = std::max<std::size_t>(mask[2*k], pos);
+      std::size_t e = std::min<std::size_t>(mask[2*k] + mask[2*k+1], pos + len);
+      std::fill(out + (b - pos), out + (e - pos), 'N');
+    }
+  }
+
+  std::string
+  substr(std::size_t pos, std::size_t len) const
+  {
+    std::string s(len, 'N');
+    extract(pos, len, &s[0]);
+    return s;
+  }
+};
+
+/// Maps the packed genome 'path' for the tools: if the file cannot be
+/// mapped the error is printed and the program exits.
+inline PackedGenome
+load_packed_genome(const std::string& path)
+{
+  try {
+    return PackedGenome::map_file(path);
+  } catch (const std::runtime_error& e) {
+    std::cerr << e.what() << "\n";
+    exit(1);
+  }
+}
+
+/// True if 'path' names a packed genome (by extension).
+inline bool
+is_packed_genome_path(const std::string& path)
+{
+  const std::string ext = ".2bit";
+  return path.size() > ext.size() &&
+    path.compare(path.size() - ext.size(), ext.size(), ext) == 0;
+}
+
+#endif
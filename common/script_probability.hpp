@@ -0,0 +1,156 @@
+// script_probability.hpp
+
+// Copyright 2020 Michele Schimd
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RES_SW_SCRIPT_PROBABILITY_HPP
+#define RES_SW_SCRIPT_PROBABILITY_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/// Total probability of the edit scripts transforming x into y, where
+/// each operation has probability pM (match), pS (substitution), pD
+/// (deletion of a symbol of x) or pI (insertion of a symbol of y).
+///
+/// The DP keeps a single row (O(|y|) memory). Values are rescaled
+/// when a row gets too small (or large) and the scaling is kept as a
+/// logarithm, so the result does not underflow for long strings;
+/// log_probability() returns its natural logarithm. Without
+/// rescaling the result is the same as the full matrix DP.
+///
+/// An instance reuses its buffers between calls (one per thread).
+class ScriptProbability
+{
+private:
+  double              pM;
+  double              pS;
+  double              pD;
+  double              pI;
+  std::vector<double> prev;
+  std::vector<double> cur;
+  // pMS[c*(m+1) + j]: pM if y[j-1] == c, pS otherwise
+  std::vector<double> pMS;
+
+  static constexpr double Low = 1e-150;
+  static constexpr double High = 1e150;
+
+  /// Prepares the pMS rows of y.
+  template <typename It_>
+  void
+  set_y(It_ yb, It_ ye)
+  {
+    std::size_t m = static_cast<std::size_t>(ye - yb);
+    pMS.assign(256*(m+1), pS);
+    for (std::size_t j = 1; j < m+1; ++j, ++yb) {
+      pMS[static_cast<unsigned char>(*yb)*(m+1) + j] = pM;
+    }
+    prev.resize(m+1);
+    cur.resize(m+1);
+  }
+
+  /// DP of x against the y of the last set_y(); returns the scaled
+  /// probability and stores the log of the scale in 'log_scale'.
+  template <typename It_>
+  double
+  run(It_ xb, It_ xe, double& log_scale)
+  {
+    const std::size_t m = prev.size() - 1;
+    log_scale = 0;
+    prev[0] = 1;
+    for (std::size_t j = 1; j < m+1; ++j) {
+      prev[j] = prev[j-1] * pI;
+    }
+    for (; xb != xe; ++xb) {
+      const double* ms = &pMS[static_cast<unsigned char>(*xb)*(m+1)];
+      cur[0] = prev[0] * pD;
+      double top = cur[0];
+      for (std::size_t j = 1; j < m+1; ++j) {
+	cur[j] = prev[j]*pD + cur[j-1]*pI + prev[j-1]*ms[j];
+	top = std::max(top, cur[j]);
+      }
+      if (top > 0 && (top < Low || top > High)) {
+	double inv = 1.0 / top;
+	for (std::size_t j = 0; j < m+1; ++j) {
+	  cur[j] *= inv;
+	}
+	log_scale += std::log(top);
+      }
+      std::swap(prev, cur);
+    }
+    return prev[m];
+  }
+
+public:
+  /// 'ps' holds pM, pS, pD and pI (in this order).
+  explicit ScriptProbability(const std::vector<double>& ps)
+    : pM(ps[0]), pS(ps[1]), pD(ps[2]), pI(ps[3]), prev(), cur(), pMS()
+  { }
+
+  template <typename ItX_, typename ItY_>
+  double
+  log_probability(ItX_ xb, ItX_ xe, ItY_ yb, ItY_ ye)
+  {
+    set_y(yb, ye);
+    double log_scale;
+    double p = run(xb, xe, log_scale);
+    return std::log(p) + log_scale;
+  }
+
+  double
+  log_probability(const std::string& x, const std::string& y)
+  {
+    return log_probability(x.begin(), x.end(), y.begin(), y.end());
+  }
+
+  /// Probability (not logarithm), may underflow to 0 for long strings.
+  double
+  probability(const std::string& x, const std::string& y)
+  {
+    set_y(y.begin(), y.end());
+    double log_scale;
+    double p = run(x.begin(), x.end(), log_scale);
+    return (log_scale == 0) ? p : p * std::exp(log_scale);
+  }
+
+  /// \brief Scores 'read' against the windows [s, s+window) of
+  /// 'genome' (a std::string or PackedGenome) for s in 'starts': the
+  /// log probability that the window turned into the read. Windows
+  /// are truncated at the end of the genome. The tables of the read
+  /// are built once for the whole batch.
+  template <typename GenomeT_>
+  std::vector<double>
+  log_probability(const std::string& read, const GenomeT_& genome,
+		  const std::vector<std::size_t>& starts, std::size_t window)
+  {
+    std::vector<double> out;
+    out.reserve(starts.size());
+    set_y(read.begin(), read.end());
+    std::string x;
+    for (std::size_t s : starts) {
+      s = std::min<std::size_t>(s, genome.size());
+      std::size_t l = std::min(window, genome.size() - s);
+      x.assign(genome.begin() + s, genome.begin() + s + l);
+      double log_scale;
+      double p = run(x.begin(), x.end(), log_scale);
+      out.push_back(std::log(p) + log_scale);
+    }
+    return out;
+  }
+};
+
+#endif
@@ -0,0 +1,137 @@
+// sigma_trie.hpp
+
+// Copyright 2020 Michele Schimd
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RES_SW_SIGMA_TRIE_HPP
+#define RES_SW_SIGMA_TRIE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/// Enumeration of all the strings y in Sigma^N (in the order of
+/// ctl::SigmaNIterator) together with the script probability and the
+/// edit distance of (x, y).
+///
+/// Sigma^N is visited as a trie in depth first order. Column j of
+/// both DP matrices only depends on column j-1 and on y[j-1], so
+/// columns are kept in a stack (column j for the current prefix of
+/// length j) and moving to the next string only recomputes the
+/// columns after the common prefix: about |Sigma|/(|Sigma|-1) columns
+/// per string instead of N.
+class SigmaTrieDP
+{
+private:
+  std::string              x;
+  std::string              sigma;
+  std::size_t              N;
+  double                   pM;
+  double                   pS;
+  double                   pD;
+  double                   pI;
+  // column j of the probability and distance DPs at [j*(|x|+1), ...)
+  std::vector<double>      prob;
+  std::vector<std::size_t> dist;
+  std::string              y;
+
+  /// Computes column j from column j-1 and y[j-1].
+  void
+  column(std::size_t j)
+  {
+    const std::size_t n = x.size();
+    const double* pp = &prob[(j-1)*(n+1)];
+    double* pc = &prob[j*(n+1)];
+    const std::size_t* dp = &dist[(j-1)*(n+1)];
+    std::size_t* dc = &dist[j*(n+1)];
+    const char c = y[j-1];
+    pc[0] = pp[0] * pI;
+    dc[0] = j;
+    for (std::size_t i = 1; i < n+1; ++i) {
+      bool match = (x[i-1] == c);
+      double pMS = match ? pM : pS;
+      pc[i] = pc[i-1]*pD + pp[i]*pI + pp[i-1]*pMS;
+      dc[i] = std::min({dc[i-1] + 1, dp[i] + 1, dp[i-1] + (match ? 0 : 1)});
+    }
+  }
+
+public:
+  /// 'ps' holds the probabilities of match, substitution, deletion and
+  /// insertion (as ed_scripts_probability).
+  SigmaTrieDP(const std::string& x_, const std::string& sigma_,
+	      std::size_t N_, const std::vector<double>& ps)
+    : x(x_), sigma(sigma_), N(N_), pM(ps[0]), pS(ps[1]), pD(ps[2]),
+      pI(ps[3]), prob((N_+1)*(x_.size()+1)), dist((N_+1)*(x_.size()+1)),
+      y(N_, sigma_.empty() ? ' ' : sigma_[0])
+  {
+    // column 0: only deletions
+    prob[0] = 1;
+    dist[0] = 0;
+    for (std::size_t i = 1; i < x.size()+1; ++i) {
+      prob[i] = prob[i-1] * pD;
+      dist[i] = i;
+    }
+  }
+
+  /// Calls visit(y, probability, distance) for every y in Sigma^N
+  /// starting with 'prefix' (truncated to N symbols).
+  template <typename VisitF_>
+  void
+  run(const std::string& prefix, VisitF_ visit)
+  {
+    if (sigma.empty() && N > 0) {
+      return;
+    }
+    const std::size_t n = x.size();
+    const std::size_t s = sigma.size();
+    const std::size_t p = std::min(prefix.size(), N);
+    for (std::size_t j = 0; j < p; ++j) {
+      y[j] = prefix[j];
+      column(j+1);
+    }
+    std::vector<std::size_t> idx(N, 0);
+    // columns [0, d] are valid for the current y
+    std::size_t d = p;
+    while (true) {
+      for (; d < N; ++d) {
+	y[d] = sigma[idx[d]];
+	column(d+1);
+      }
+      visit(static_cast<const std::string&>(y), prob[N*(n+1)+n],
+	    dist[N*(n+1)+n]);
+      // next string: increment the last free position that can be
+      std::size_t k = N;
+      while (k > p && idx[k-1] + 1 == s) {
+	idx[k-1] = 0;
+	--k;
+      }
+      if (k == p) {
+	return;
+      }
+      ++idx[k-1];
+      d = k-1;
+    }
+  }
+
+  /// Calls visit(y, probability, distance) for every y in Sigma^N.
+  template <typename VisitF_>
+  void
+  run(VisitF_ visit)
+  {
+    run(std::string(), visit);
+  }
+};
+
+#endif
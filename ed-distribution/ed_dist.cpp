@@ -0,0 +1,171 @@
+// ed_dist.cpp
+
+// Copyright 2020 Michele Schimd
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <ctl.h>
+
+#include <sigma_trie.hpp>
+
+// Exact distribution of ED(x,Y) for Y uniform in Sigma^n, for a
+// given x or for X also uniform in Sigma^n, together with the script
+// probability mass (sum of ed_scripts_probability(x,y)) of each
+// distance.
+//
+// The work (pairs of x and prefix of y) is cut in items that threads
+// take from a shared atomic counter, so threads that finish early
+// keep taking work; each thread fills its own histogram and the
+// histograms are merged at the end.
+
+const std::string Sigma = "ACGT";
+
+/// Number of items per thread, enough to balance the load.
+constexpr std::size_t ItemsPerThread = 64;
+
+struct Histogram
+{
+  std::vector<std::uint64_t> count;
+  std::vector<double>        mass;
+
+  explicit Histogram(std::size_t max_d)
+    : count(max_d + 1, 0), mass(max_d + 1, 0.0) { }
+
+  void
+  merge(const Histogram& o)
+  {
+    for (std::size_t d = 0; d < count.size(); ++d) {
+      count[d] += o.count[d];
+      mass[d] += o.mass[d];
+    }
+  }
+};
+
+/// i-th string of Sigma^len in lexicographic order.
+std::string
+sigma_string(std::uint64_t i, std::size_t len)
+{
+  std::string s(len, Sigma[0]);
+  for (std::size_t k = len; k-- > 0; ) {
+    s[k] = Sigma[i % Sigma.size()];
+    i /= Sigma.size();
+  }
+  return s;
+}
+
+std::uint64_t
+power(std::uint64_t b, std::size_t e)
+{
+  std::uint64_t r = 1;
+  while (e-- > 0) {
+    r *= b;
+  }
+  return r;
+}
+
+/// \brief Distribution of ED(x,y) over the x in 'xs' (if empty, all of
+/// Sigma^n) and all y in Sigma^n.
+Histogram
+ed_distribution(const std::vector<std::string>& xs, std::size_t n,
+		std::size_t threads, const std::vector<double>& probs)
+{
+  const bool all = xs.empty();
+  const std::uint64_t n_x = all ? power(Sigma.size(), n) : xs.size();
+  std::size_t max_d = n;
+  for (const std::string& x : xs) {
+    max_d = std::max(max_d, x.size());
+  }
+  // shortest y prefix giving enough items
+  std::size_t p = 0;
+  while (p < n && n_x * power(Sigma.size(), p) < ItemsPerThread * threads) {
+    ++p;
+  }
+  const std::uint64_t prefixes = power(Sigma.size(), p);
+  const std::uint64_t items = n_x * prefixes;
+
+  std::atomic<std::uint64_t> next(0);
+  std::vector<Histogram> local(threads, Histogram(max_d));
+  auto worker = [&](std::size_t t) {
+    Histogram& h = local[t];
+    auto visit = [&h](const std::string&, double pe, std::size_t d) {
+      h.count[d]++;
+      h.mass[d] += pe;
+    };
+    std::uint64_t item;
+    while ((item = next.fetch_add(1)) < items) {
+      std::uint64_t xi = item / prefixes;
+      std::string x = all ? sigma_string(xi, n) : xs[xi];
+      SigmaTrieDP trie(x, Sigma, n, probs);
+      trie.run(sigma_string(item % prefixes, p), visit);
+    }
+  };
+  std::vector<std::thread> pool;
+  for (std::size_t t = 0; t < threads; ++t) {
+    pool.emplace_back(worker, t);
+  }
+  for (auto& th : pool) {
+    th.join();
+  }
+  Histogram h(max_d);
+  for (const Histogram& l : local) {
+    h.merge(l);
+  }
+  return h;
+}
+
+int
+main(int argc, char** argv)
+{
+  // the probabilities are given all four or none
+  if (argc != 3 && argc != 4 && argc != 8) {
+    std::cerr << "Invalid usage\n"
+	      << "  ed-dist n x|all [threads] [pM pS pD pI]\n";
+    return 1;
+  }
+  std::size_t n = ctl::from_string<std::size_t>(argv[1]);
+  std::string x = argv[2];
+  std::size_t threads = std::thread::hardware_concurrency();
+  if (argc > 3) {
+    threads = ctl::from_string<std::size_t>(argv[3]);
+  }
+  threads = std::max<std::size_t>(1, threads);
+  std::vector<double> probs {0.6, 0.2, 0.1, 0.1};
+  if (argc == 8) {
+    for (std::size_t i = 0; i < 4; ++i) {
+      probs[i] = ctl::from_string<double>(argv[4 + i]);
+    }
+  }
+  std::vector<std::string> xs;
+  if (x != "all") {
+    xs.push_back(x);
+  }
+  Histogram h = ed_distribution(xs, n, threads, probs);
+  std::uint64_t tot = 0;
+  for (std::uint64_t c : h.count) {
+    tot += c;
+  }
+  std::cout << "distance,count,frequency,mass\n";
+  for (std::size_t d = 0; d < h.count.size(); ++d) {
+    std::cout << d << "," << h.count[d] << ","
+	      << static_cast<double>(h.count[d]) / tot << "," << h.mass[d]
+	      << "\n";
+  }
+  return 0;
+}
@@ -0,0 +1,257 @@
+// script_space.hpp
+
+// Copyright 2020 Michele Schimd
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RES_SW_SCRIPT_SPACE_HPP
+#define RES_SW_SCRIPT_SPACE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <string>
+#include <vector>
+
+// An edit script transforms x into y with the operations M (match),
+// S (substitution), D (deletion of a symbol of x) and I (insertion of
+// a symbol of y); a script is a path from (0,0) to (n,m) in the DP
+// grid and its cost is the number of S, D and I.
+
+constexpr std::size_t NoCostLimit = std::numeric_limits<std::size_t>::max();
+
+class ScriptEnumerator;
+
+/// The space of the edit scripts between x and y. Holds the edit
+/// distance of every pair of suffixes (x[i,n), y[j,m)), used to count
+/// scripts and to prune the enumeration.
+class ScriptSpace
+{
+private:
+  std::string              x;
+  std::string              y;
+  std::size_t              n;
+  std::size_t              m;
+  // dist[i*(m+1)+j] = ED(x[i,n), y[j,m))
+  std::vector<std::size_t> dist;
+
+public:
+  ScriptSpace(const std::string& x_, const std::string& y_)
+    : x(x_), y(y_), n(x_.size()), m(y_.size()), dist((n+1)*(m+1))
+  {
+    for (std::size_t i = n+1; i-- > 0; ) {
+      for (std::size_t j = m+1; j-- > 0; ) {
+	std::size_t d;
+	if (i == n) {
+	  d = m - j;
+	} else if (j == m) {
+	  d = n - i;
+	} else {
+	  d = std::min({remaining(i+1, j) + 1, remaining(i, j+1) + 1,
+		remaining(i+1, j+1) + (x[i] != y[j])});
+	}
+	dist[i*(m+1)+j] = d;
+      }
+    }
+  }
+
+  std::size_t rows() const { return n; }
+  std::size_t cols() const { return m; }
+  const std::string& first() const { return x; }
+  const std::string& second() const { return y; }
+
+  /// Minimum cost to complete a script from cell (i,j).
+  std::size_t remaining(std::size_t i, std::size_t j) const
+  {
+    return dist[i*(m+1)+j];
+  }
+
+  std::size_t distance() const { return remaining(0, 0); }
+
+  /// Number of scripts of each cost, c[k] scripts have cost k. The
+  /// counts grow exponentially, hence doubles (exact up to 2^53).
+  std::vector<double>
+  count_by_cost() const
+  {
+    const std::size_t C = n + m + 1;
+    // rows i+1 (next) and i (cur) of the suffix counts, C per cell
+    std::vector<double> next((m+1)*C, 0.0);
+    std::vector<double> cur((m+1)*C, 0.0);
+    for (std::size_t i = n+1; i-- > 0; ) {
+      for (std::size_t j = m+1; j-- > 0; ) {
+	double* c = &cur[j*C];
+	std::fill(c, c + C, 0.0);
+	if (i == n && j == m) {
+	  c[0] = 1.0;
+	  continue;
+	}
+	if (j < m) {
+	  const double* ins = &cur[(j+1)*C];
+	  for (std::size_t k = 1; k < C; ++k) {
+	    c[k] += ins[k-1];
+	  }
+	}
+	if (i < n) {
+	  const double* del = &next[j*C];
+	  for (std::size_t k = 1; k < C; ++k) {
+	    c[k] += del[k-1];
+	  }
+	}
+	if (i < n && j < m) {
+	  const double* diag = &next[(j+1)*C];
+	  std::size_t s = (x[i] != y[j]) ? 1 : 0;
+	  for (std::size_t k = s; k < C; ++k) {
+	    c[k] += diag[k-s];
+	  }
+	}
+      }
+      std::swap(cur, next);
+    }
+    // the last swap moved row 0 in 'next'
+    return std::vector<double>(next.begin(), next.begin() + C);
+  }
+
+  /// Number of scripts with cost at most 'max_cost'.
+  double
+  count(std::size_t max_cost = NoCostLimit) const
+  {
+    std::vector<double> c = count_by_cost();
+    double tot = 0;
+    for (std::size_t k = 0; k < c.size() && k <= max_cost; ++k) {
+      tot += c[k];
+    }
+    return tot;
+  }
+
+  /// Lazy enumeration of the scripts with cost at most 'max_cost'
+  /// (distance() for optimal scripts only).
+  ScriptEnumerator enumerate(std::size_t max_cost = NoCostLimit) const;
+};
+
+/// Depth first enumeration of the scripts of a ScriptSpace. The
+/// current script is the path of the search, kept in a single string
+/// that grows and shrinks by one operation, so consecutive scripts
+/// share their common prefix and no script is materialized in
+/// advance. Branches that cannot end within the cost limit (cost so
+/// far plus the edit distance of the remaining suffixes) are never
+/// entered, so every step leads to a script.
+///
+///   auto it = space.enumerate(space.distance());
+///   while (it.next()) { use(it.script(), it.cost()); }
+class ScriptEnumerator
+{
+private:
+  struct Frame
+  {
+    std::size_t i;
+    std::size_t j;
+    std::size_t cost;
+    // next operation to try: 0 I, 1 D, 2 M/S, 3 none
+    int         op;
+  };
+
+  const ScriptSpace* space;
+  std::size_t        budget;
+  std::vector<Frame> stack;
+  std::string        E;
+  std::size_t        E_cost;
+
+  void
+  pop()
+  {
+    stack.pop_back();
+    if (!stack.empty()) {
+      E.pop_back();
+    }
+  }
+
+public:
+  ScriptEnumerator(const ScriptSpace& s, std::size_t max_cost)
+    : space(&s), budget(max_cost), stack(), E(), E_cost(0)
+  {
+    if (s.distance() <= budget) {
+      stack.push_back(Frame{0, 0, 0, 0});
+      E.reserve(s.rows() + s.cols());
+    }
+  }
+
+  /// Moves to the next script, returns false when there are no more.
+  bool
+  next()
+  {
+    const std::size_t n = space->rows();
+    const std::size_t m = space->cols();
+    const std::string& x = space->first();
+    const std::string& y = space->second();
+    while (!stack.empty()) {
+      Frame& f = stack.back();
+      if (f.i == n && f.j == m) {
+	if (f.op == 0) {
+	  f.op = 3;
+	  E_cost = f.cost;
+	  return true;
+	}
+	pop();
+	continue;
+      }
+      if (f.op > 2) {
+	pop();
+	continue;
+      }
+      int op = f.op++;
+      Frame c {f.i, f.j, f.cost + 1, 0};
+      char sym;
+      if (op == 0) {
+	if (f.j == m) {
+	  continue;
+	}
+	++c.j;
+	sym = 'I';
+      } else if (op == 1) {
+	if (f.i == n) {
+	  continue;
+	}
+	++c.i;
+	sym = 'D';
+      } else {
+	if (f.i == n || f.j == m) {
+	  continue;
+	}
+	++c.i;
+	++c.j;
+	bool match = (x[f.i] == y[f.j]);
+	c.cost -= match ? 1 : 0;
+	sym = match ? 'M' : 'S';
+      }
+      if (c.cost + space->remaining(c.i, c.j) > budget) {
+	continue;
+      }
+      E.push_back(sym);
+      stack.push_back(c);
+    }
+    return false;
+  }
+
+  /// The current script, valid until the next call to next().
+  const std::string& script() const { return E; }
+
+  std::size_t cost() const { return E_cost; }
+};
+
+inline ScriptEnumerator
+ScriptSpace::enumerate(std::size_t max_cost) const
+{
+  return ScriptEnumerator(*this, max_cost);
+}
+
+#endif
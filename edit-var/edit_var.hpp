@@ -0,0 +1,302 @@
+// edit_var.hpp
+
+// Copyright 2019 Michele Schimd
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RES_SW_EDIT_VAR_HPP
+#define RES_SW_EDIT_VAR_HPP
+
+#include <ctl.h>
+
+#include <string>
+#include <vector>
+#include <list>
+#include <utility>
+
+#include "variation_type.hpp"
+#include "variant_store.hpp"
+
+// TODO: Study and, if appropriate, support to rGFA
+// https://github.com/lh3/gfatools/blob/master/doc/rGFA.md
+// by Heng Li
+
+// TODO: The order in which insertions and deletions are applied is
+// not unimportant. We must find a way to make the act of a script
+// consisten regardless such order. Probably we must go through an
+// intermediate representation.
+
+template <typename PosT_, typename StrT_, typename TypeT_ = int>
+class local_var
+{
+private:
+  PosT_       j;
+  StrT_       v;
+  TypeT_      t;
+  // symbols affected (deletions keep no symbols, only their length)
+  std::size_t l;
+public:
+  local_var(PosT_ j_, StrT_ v_, TypeT_ t_)
+    : j(j_), v(v_), t(t_), l(v.size()) { }
+
+  local_var(PosT_ j_, StrT_ v_, TypeT_ t_, std::size_t l_)
+    : j(j_), v(v_), t(t_), l(l_) { }
+
+  PosT_ position() const { return j; }
+  StrT_ variation() const { return v; }
+  TypeT_ type() const { return t; }
+  std::size_t length() const { return l; }
+  
+};
+
+
+/// Calls f(position, type, length, data) for each variation of 'v' in
+/// order, 'data' are the new symbols (unused for deletions).
+template <typename PosT_, typename StrT_, typename TypeT_, typename F_>
+void
+for_each_variation(const std::list<local_var<PosT_, StrT_, TypeT_>>& v, F_ f)
+{
+  for (const auto& var : v) {
+    const StrT_ w = var.variation();
+    f(var.position(), var.type(), var.length(), w.data());
+  }
+}
+
+/// Same as above for the variations of a VariantStore.
+template <typename F_>
+void
+for_each_variation(const VariantStore& v, F_ f)
+{
+  v.for_each([&f](const VariantRecord& r) {
+      f(r.position, r.type, r.length, r.data);
+    });
+}
+
+
+template <typename VarsT_, typename TagT_>
+class sequence_var
+{
+private:
+
+  TagT_  tag;
+  VarsT_ variations;
+  
+public:
+  sequence_var(TagT_ t_) : tag(t_), variations()
+    { }
+
+  sequence_var(VarsT_ v_, TagT_ t_) : tag(t_), variations(std::move(v_))
+    { }
+
+  /// Variations must be added by non decreasing position.
+  template <typename VarT_>
+  void
+  add_variation(const VarT_& v_) { variations.push_back(v_); }
+
+  const VarsT_& variation_list() const { return variations; }
+
+  const TagT_& variant_tag() const { return tag; }
+
+  // !! Probably this should go outside this class
+  template <typename StrT_>
+  StrT_
+  apply(const StrT_& ref)
+  {
+    StrT_ str(ref);
+    for_each_variation(variations, [&str](std::size_t pos, int type,
+					  std::size_t len, const char* vstr)
+    {
+      // Substitution
+      if (type == SubstitutionType) {
+	std::copy(vstr, vstr + len, str.begin()+pos);
+      }
+      // Deletion
+      // Mark deleted symbols with '-'
+      
+      // Insertion Insert position always refer to original
+      // string. Thus if j is found, it means insert BEFORE ref[j]
+      // j=0,...,n. When j=n menas insert at the end.
+    });
+
+    // copy without '-' (deletions)
+    return str;
+  }
+  
+};
+
+
+template <typename StrT_, typename SeqVarsT_>
+class edit_var
+{
+private:
+
+  using VarsT_ = typename SeqVarsT_::value_type;
+  
+  StrT_     backbone;
+  SeqVarsT_ variants;
+
+public:
+  edit_var(StrT_ bb) :
+    backbone(bb), variants() {}
+
+  void
+  add_variant(VarsT_ v)
+  {
+    variants.push_back(std::move(v));
+  }
+
+  const StrT_&
+  backbone_sequence() const { return backbone; }
+
+  std::size_t
+  variant_count() const { return variants.size(); }
+
+  const VarsT_&
+  variant(std::size_t i) const { return variants[i]; }
+
+};
+
+
+
+// Variation is represented as: position, text and type
+using Variation = local_var<std::size_t, std::string, int>;
+// Conveniente alias for a list of Variation
+using VariationList = std::list<Variation>;
+// A variant is a store of variations with an associated tag
+using SequenceVariant = sequence_var<VariantStore, int>;
+// Preferred variations structure has
+//   backbone   : std::string
+//   variations : vector of SequenceVariation
+using EditVars = edit_var<std::string,
+			  std::vector<SequenceVariant>>;
+
+
+// ---------------------------------------------------------
+//                     FACTORY FUNCTIONS 
+// ---------------------------------------------------------
+
+
+// ------------------------ Variation ----------------------
+
+/// Makes a substitution variation
+inline Variation
+make_sub_var(std::size_t j, const std::string& v)
+{
+  return Variation(j, v, SubstitutionType);
+}
+
+inline Variation
+make_ins_var(std::size_t j, const std::string& v)
+{
+  return Variation(j, v, InsertionType);
+}
+
+inline Variation
+make_del_var(std::size_t j, std::size_t d)
+{
+  return Variation(j, std::string(), DeletionType, d);
+}
+
+// --------------------- VariationList ---------------------
+inline VariationList
+make_empty_variation_list()
+{
+  return std::list<Variation>();
+}
+
+template <typename It_>
+VariationList
+make_variation_list_from_iterator(It_ begin, It_ end)
+{
+  VariationList vlist = make_empty_variation_list();
+  for (; begin != end; ++begin) {
+    vlist.push_back(*begin);
+  }
+  return std::move(vlist);
+}
+
+/// The variations of a store as a VariationList.
+inline VariationList
+make_variation_list(const VariantStore& s)
+{
+  VariationList v;
+  s.for_each([&v](const VariantRecord& r) {
+      if (r.type == DeletionType) {
+	v.push_back(make_del_var(r.position, r.length));
+      } else {
+	v.push_back(Variation(r.position, std::string(r.data, r.length),
+			      r.type));
+      }
+    });
+  return v;
+}
+
+// -------------------- SequenceVariant --------------------
+inline SequenceVariant
+make_empty_sequence_variant(int tag)
+{
+  return SequenceVariant(tag);
+}
+
+inline SequenceVariant
+make_sequence_variant(const VariationList& vlist, int tag)
+{
+  return SequenceVariant(VariantStore::from_variation_list(vlist), tag);
+}
+
+inline SequenceVariant
+make_sequence_variant(VariantStore store, int tag)
+{
+  return SequenceVariant(std::move(store), tag);
+}
+
+
+// !!! Elements in 'v' (a VariationList or a VariantStore) must be
+// sorted wrt the position. In all other cases the output is
+// meaningless (it may even lead to unexpected behavior, crash
+// included).
+template <typename VarsT_>
+std::string
+apply_script_to_string(const VarsT_& v, const std::string& x)
+{
+  std::string y;
+  std::size_t n = x.size();
+  std::size_t j = 0;
+  for_each_variation(v, [&](std::size_t p, int t, std::size_t l,
+			    const char* w) {
+      if (j >= n) {
+	return;
+      }
+      if (j<p) {
+	y.append(x, j, p-j);
+	j = p;
+      }
+      if (t == SubstitutionType) {
+	y.append(w, l);
+	j += l;
+      } 
+      if(t == InsertionType) {
+	y.append(w, l);
+      } 
+      if (t == DeletionType) {
+	j += l;
+      }
+    });
+  // there may be some match remaining
+  if (j<n) {
+    y.append(x, j, n-j);
+  }
+  return y;
+}
+
+#endif
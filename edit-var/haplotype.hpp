@@ -0,0 +1,284 @@
+// haplotype.hpp
+
+// Copyright 2020 Michele Schimd
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RES_SW_HAPLOTYPE_HPP
+#define RES_SW_HAPLOTYPE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "edit_var.hpp"
+
+/// Piece of a haplotype: 'length' symbols starting at 'offset' either
+/// in the backbone or in the haplotype's own buffer of inserted and
+/// substituted symbols.
+struct Piece
+{
+  bool        backbone;
+  std::size_t offset;
+  std::size_t length;
+};
+
+/// A SequenceVariant applied to a backbone, represented as a piece
+/// table: the unchanged stretches point into the (shared) backbone and
+/// only the symbols introduced by the variations are stored. The
+/// memory is proportional to the number of variations, not to the
+/// length of the sequence, so many haplotypes of a large backbone can
+/// be kept at once. The backbone must outlive the haplotype.
+class Haplotype
+{
+private:
+  const std::string*       bb;
+  std::vector<Piece>       pieces;
+  // start of each piece in the haplotype (for random access)
+  std::vector<std::size_t> starts;
+  std::string              added;
+  std::size_t              length;
+
+  void
+  push(bool from_backbone, std::size_t offset, std::size_t len)
+  {
+    if (len == 0) {
+      return;
+    }
+    if (!pieces.empty()) {
+      Piece& last = pieces.back();
+      if (last.backbone == from_backbone &&
+	  last.offset + last.length == offset) {
+	last.length += len;
+	length += len;
+	return;
+      }
+    }
+    starts.push_back(length);
+    pieces.push_back(Piece{from_backbone, offset, len});
+    length += len;
+  }
+
+  const char*
+  piece_data(const Piece& p) const
+  {
+    return (p.backbone ? bb->data() : added.data()) + p.offset;
+  }
+
+public:
+  /// Applies the variations 'v' (a VariationList or a VariantStore,
+  /// sorted by position, same semantic as apply_script_to_string) to
+  /// 'backbone'.
+  template <typename VarsT_>
+  Haplotype(const std::string& backbone, const VarsT_& v)
+    : bb(&backbone), pieces(), starts(), added(), length(0)
+  {
+    const std::size_t n = backbone.size();
+    std::size_t j = 0;
+    for_each_variation(v, [&](std::size_t pos, int t, std::size_t l,
+			      const char* w) {
+	if (j >= n) {
+	  return;
+	}
+	std::size_t p = std::min(pos, n);
+	if (j < p) {
+	  push(true, j, p - j);
+	  j = p;
+	}
+	if (t == SubstitutionType || t == InsertionType) {
+	  push(false, added.size(), l);
+	  added.append(w, l);
+	}
+	if (t == SubstitutionType || t == DeletionType) {
+	  j += l;
+	}
+      });
+    if (j < n) {
+      push(true, j, n - j);
+    }
+  }
+
+  std::size_t size() const { return length; }
+
+  std::size_t piece_count() const { return pieces.size(); }
+
+  const std::vector<Piece>& piece_list() const { return pieces; }
+
+  /// Position in the haplotype of the first symbol of piece k.
+  std::size_t piece_start(std::size_t k) const { return starts[k]; }
+
+  /// Symbols of piece k.
+  const char* piece_symbols(std::size_t k) const { return piece_data(pieces[k]); }
+
+  /// Index of the piece containing position i.
+  std::size_t
+  piece_at(std::size_t i) const
+  {
+    return static_cast<std::size_t>(
+      std::upper_bound(starts.begin(), starts.end(), i) - starts.begin()) - 1;
+  }
+
+  char
+  at(std::size_t i) const
+  {
+    std::size_t k = piece_at(i);
+    return piece_data(pieces[k])[i - starts[k]];
+  }
+
+  /// Copies the symbols [pos, pos+len) in 'out'.
+  void
+  extract(std::size_t pos, std::size_t len, char* out) const
+  {
+    len = std::min(len, length - std::min(pos, length));
+    if (len == 0) {
+      return;
+    }
+    std::size_t k = piece_at(pos);
+    while (len > 0) {
+      std::size_t skip = pos - starts[k];
+      std::size_t l = std::min(len, pieces[k].length - skip);
+      std::copy(piece_data(pieces[k]) + skip, piece_data(pieces[k]) + skip + l,
+		out);
+      out += l;
+      pos += l;
+      len -= l;
+      ++k;
+    }
+  }
+
+  /// Calls f(const char* data, size_t len) for each piece in order.
+  template <typename F_>
+  void
+  for_each_piece(F_ f) const
+  {
+    for (const Piece& p : pieces) {
+      f(piece_data(p), p.length);
+    }
+  }
+
+  /// Writes the sequence on 'os' without materializing it.
+  void
+  write(std::ostream& os) const
+  {
+    for_each_piece([&os](const char* d, std::size_t l) { os.write(d, l); });
+  }
+
+  std::string
+  str() const
+  {
+    std::string s;
+    s.reserve(length);
+    for_each_piece([&s](const char* d, std::size_t l) { s.append(d, l); });
+    return s;
+  }
+};
+
+/// Builds the haplotypes of all the variants of 'evg' using 'threads'
+/// threads. The haplotypes refer to evg's backbone.
+inline std::vector<Haplotype>
+make_haplotypes(const EditVars& evg, std::size_t threads)
+{
+  const std::size_t V = evg.variant_count();
+  threads = std::max<std::size_t>(1, std::min(threads, V));
+  std::vector<std::vector<Haplotype>> parts(threads);
+  auto worker = [&](std::size_t t) {
+    // contiguous ranges keep the output in variant order
+    for (std::size_t i = t * V / threads; i < (t+1) * V / threads; ++i) {
+      parts[t].emplace_back(evg.backbone_sequence(),
+			    evg.variant(i).variation_list());
+    }
+  };
+  std::vector<std::thread> pool;
+  for (std::size_t t = 0; t < threads; ++t) {
+    pool.emplace_back(worker, t);
+  }
+  for (auto& th : pool) {
+    th.join();
+  }
+  std::vector<Haplotype> out;
+  out.reserve(V);
+  for (auto& p : parts) {
+    std::move(p.begin(), p.end(), std::back_inserter(out));
+  }
+  return out;
+}
+
+/// Writes the haplotypes of all the variants of 'evg' as fasta records
+/// (header: names[i] for variant i) with 'line' symbols per line.
+/// Haplotypes are rendered by 'threads' threads, 'threads' at a time,
+/// and written in variant order with one write per haplotype.
+inline void
+write_haplotypes(std::ostream& os, const EditVars& evg,
+		 const std::vector<std::string>& names, std::size_t threads,
+		 std::size_t line = 80)
+{
+  const std::size_t V = evg.variant_count();
+  threads = std::max<std::size_t>(1, threads);
+  std::vector<std::string> text(threads);
+  for (std::size_t r = 0; r < V; r += threads) {
+    std::size_t round = std::min(threads, V - r);
+    auto worker = [&](std::size_t t) {
+      const SequenceVariant& var = evg.variant(r + t);
+      Haplotype h(evg.backbone_sequence(), var.variation_list());
+      std::string& out = text[t];
+      out = ">" + names[r + t] + "\n";
+      std::size_t col = 0;
+      h.for_each_piece([&](const char* d, std::size_t l) {
+	  while (l > 0) {
+	    std::size_t c = std::min(l, line - col);
+	    out.append(d, c);
+	    d += c;
+	    l -= c;
+	    col += c;
+	    if (col == line) {
+	      out.push_back('\n');
+	      col = 0;
+	    }
+	  }
+	});
+      if (col > 0) {
+	out.push_back('\n');
+      }
+    };
+    std::vector<std::thread> pool;
+    for (std::size_t t = 0; t < round; ++t) {
+      pool.emplace_back(worker, t);
+    }
+    for (auto& th : pool) {
+      th.join();
+    }
+    for (std::size_t t = 0; t < round; ++t) {
+      os.write(text[t].data(), text[t].size());
+    }
+  }
+  os.flush();
+}
+
+/// Same as above with the variant tags as headers.
+inline void
+write_haplotypes(std::ostream& os, const EditVars& evg, std::size_t threads,
+		 std::size_t line = 80)
+{
+  std::vector<std::string> names;
+  names.reserve(evg.variant_count());
+  for (std::size_t i = 0; i < evg.variant_count(); ++i) {
+    names.push_back(std::to_string(evg.variant(i).variant_tag()));
+  }
+  write_haplotypes(os, evg, names, threads, line);
+}
+
+#endif
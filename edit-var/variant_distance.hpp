@@ -0,0 +1,338 @@
+// variant_distance.hpp
+
+// Copyright 2020 Michele Schimd
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RES_SW_VARIANT_DISTANCE_HPP
+#define RES_SW_VARIANT_DISTANCE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "edit_var.hpp"
+#include "haplotype.hpp"
+
+// Edit distance between two haplotypes of the same backbone without
+// materializing them.
+//
+// The distance is computed by diagonal transition (Landau-Vishkin):
+// for e = 0, 1, ... the furthest row reachable with e edits is kept on
+// each diagonal k = j - i in [-e, e], and every step extends it along
+// the diagonal while A[i] == B[j]. Time is O(D^2) extensions, D being
+// the distance, and memory O(D).
+//
+// The extensions are where the length of the sequences shows up, and
+// they run on the piece tables: when A[i] and B[j] come from the same
+// backbone position the two haplotypes share the rest of both pieces,
+// so the extension jumps to the end of the shorter one instead of
+// comparing symbols. Symbols are only compared inside the pieces added
+// by the variations and across unrelated backbone positions (where a
+// mismatch is usually found within a few symbols), so the cost depends
+// on the variations and not on the length of the backbone.
+//
+// The O(D^2) term is avoided by cutting the alignment at anchors: the
+// backbone stretches shared by A and B (same backbone offsets). Let an
+// anchor X = A[a, a+L) = B[b, b+L) lie between two gaps of distance
+// d1 and d2 and let u = d1 + d2. An optimal alignment that touches the
+// anchor diagonal inside X can follow it (matches are always optimal),
+// so it passes through (a, b) and (a+L, b+L). One that does not enters
+// X at shift s and leaves it at shift s' and can be rerouted through
+// the anchor at extra cost |s| + |s'| - (edits inside X). Unless X
+// matches itself shifted by at most 2u over a long run (a repeat)
+// those edits are at least |s| + |s'|, so the alignment is forced
+// through the anchor and the distance is the sum of the gap
+// distances, computed by independent diagonal transitions in
+// O(sum d_i^2). Anchors that are repeats or too short are dropped,
+// merging their gaps; when none is left this is the plain global DP.
+
+/// Length of the longest common prefix of A[i, n) and B[j, m).
+/// 'compared' and 'jumped' count the symbols matched one by one and
+/// by jumping over shared backbone stretches.
+inline std::size_t
+common_prefix(const Haplotype& A, std::size_t i, std::size_t n,
+	      const Haplotype& B, std::size_t j, std::size_t m,
+	      std::size_t& compared, std::size_t& jumped)
+{
+  std::size_t l = 0;
+  while (i < n && j < m) {
+    std::size_t ka = A.piece_at(i);
+    std::size_t kb = B.piece_at(j);
+    const Piece& pa = A.piece_list()[ka];
+    const Piece& pb = B.piece_list()[kb];
+    std::size_t sa = i - A.piece_start(ka);
+    std::size_t sb = j - B.piece_start(kb);
+    std::size_t span = std::min(std::min(pa.length - sa, pb.length - sb),
+				std::min(n - i, m - j));
+    if (pa.backbone && pb.backbone && pa.offset + sa == pb.offset + sb) {
+      jumped += span;
+    } else {
+      const char* x = A.piece_symbols(ka) + sa;
+      const char* y = B.piece_symbols(kb) + sb;
+      std::size_t t = 0;
+      while (t < span && x[t] == y[t]) {
+	++t;
+      }
+      compared += t;
+      if (t < span) {
+	return l + t;
+      }
+    }
+    l += span;
+    i += span;
+    j += span;
+  }
+  return l;
+}
+
+class VariantDistance
+{
+private:
+  /// Backbone stretch shared by A[a, a+length) and B[b, b+length).
+  struct Anchor
+  {
+    std::size_t a;
+    std::size_t b;
+    std::size_t length;
+    const char* symbols;
+  };
+
+  // furthest row on each diagonal for the current and the next e
+  std::vector<std::ptrdiff_t> row;
+  std::vector<std::ptrdiff_t> next;
+  // anchors and distance of the gap before each of them (and after
+  // the last one), an upper bound for the merged ones
+  std::vector<Anchor>         anchors;
+  std::vector<std::size_t>    gaps;
+  std::vector<bool>           merged;
+  std::size_t                 compared;
+  std::size_t                 jumped;
+
+  /// Edit distance between A[a0, a1) and B[b0, b1).
+  std::size_t
+  transition(const Haplotype& A, std::size_t a0, std::size_t a1,
+	     const Haplotype& B, std::size_t b0, std::size_t b1)
+  {
+    const std::ptrdiff_t n = static_cast<std::ptrdiff_t>(a1 - a0);
+    const std::ptrdiff_t m = static_cast<std::ptrdiff_t>(b1 - b0);
+    const std::ptrdiff_t target = m - n;
+    // rows are stored at k + e (k in [-e, e]); unreachable is -1
+    row.assign(1, static_cast<std::ptrdiff_t>(
+		 common_prefix(A, a0, a1, B, b0, b1, compared, jumped)));
+    for (std::ptrdiff_t e = 0; ; ++e) {
+      if (target >= -e && target <= e && row[target + e] == n) {
+	return static_cast<std::size_t>(e);
+      }
+      next.assign(2*e + 3, -1);
+      for (std::ptrdiff_t k = -e - 1; k <= e + 1; ++k) {
+	if (k < -n || k > m) {
+	  continue;
+	}
+	// substitution on k, deletion from k+1, insertion from k-1
+	std::ptrdiff_t i = -1;
+	if (k >= -e && k <= e && row[k + e] >= 0) {
+	  i = row[k + e] + 1;
+	}
+	if (k + 1 <= e && row[k + 1 + e] >= 0) {
+	  i = std::max(i, row[k + 1 + e] + 1);
+	}
+	if (k - 1 >= -e && row[k - 1 + e] >= 0) {
+	  i = std::max(i, row[k - 1 + e]);
+	}
+	if (i < 0) {
+	  continue;
+	}
+	i = std::min(i, std::min(n, m - k));
+	next[k + e + 1] = i + static_cast<std::ptrdiff_t>(
+	  common_prefix(A, a0 + static_cast<std::size_t>(i), a1,
+			B, b0 + static_cast<std::size_t>(i + k), b1,
+			compared, jumped));
+      }
+      std::swap(row, next);
+    }
+  }
+
+  /// Collects the backbone stretches shared by A and B, in order.
+  void
+  find_anchors(const Haplotype& A, const Haplotype& B)
+  {
+    anchors.clear();
+    const std::vector<Piece>& pa = A.piece_list();
+    const std::vector<Piece>& pb = B.piece_list();
+    std::size_t x = 0;
+    std::size_t y = 0;
+    while (x < pa.size() && y < pb.size()) {
+      if (!pa[x].backbone) {
+	++x;
+	continue;
+      }
+      if (!pb[y].backbone) {
+	++y;
+	continue;
+      }
+      std::size_t ea = pa[x].offset + pa[x].length;
+      std::size_t eb = pb[y].offset + pb[y].length;
+      std::size_t lo = std::max(pa[x].offset, pb[y].offset);
+      std::size_t hi = std::min(ea, eb);
+      if (lo < hi) {
+	anchors.push_back(Anchor{A.piece_start(x) + lo - pa[x].offset,
+				 B.piece_start(y) + lo - pb[y].offset,
+				 hi - lo,
+				 A.piece_symbols(x) + lo - pa[x].offset});
+      }
+      if (ea <= eb) {
+	++x;
+      } else {
+	++y;
+      }
+    }
+  }
+
+  /// Distance of gap g, between anchors g-1 and g.
+  std::size_t
+  gap_distance(const Haplotype& A, const Haplotype& B, std::size_t g)
+  {
+    std::size_t a0 = 0;
+    std::size_t b0 = 0;
+    if (g > 0) {
+      a0 = anchors[g-1].a + anchors[g-1].length;
+      b0 = anchors[g-1].b + anchors[g-1].length;
+    }
+    std::size_t a1 = (g < anchors.size()) ? anchors[g].a : A.size();
+    std::size_t b1 = (g < anchors.size()) ? anchors[g].b : B.size();
+    return transition(A, a0, a1, B, b0, b1);
+  }
+
+  /// True if every alignment can be moved through anchor x when the
+  /// gaps around it have distance u in total. An alignment avoiding
+  /// the anchor has |s| + |s'| + (edits inside X) <= 2u, so it would
+  /// need fewer than S = 2u edits and match X against itself at some
+  /// shift s in [1, S] over a run of at least R = (L - 2S) / S symbols.
+  /// Every such run contains a multiple of R, where the runs are
+  /// measured; in a non repetitive anchor they end within a few symbols.
+  bool
+  forced(const Anchor& x, std::size_t u) const
+  {
+    const std::size_t S = 2 * u;
+    if (S == 0) {
+      return true;
+    }
+    if (x.length < 3 * S) {
+      return false;
+    }
+    const std::size_t R = (x.length - 2*S) / S;
+    const char* X = x.symbols;
+    for (std::size_t s = 1; s <= S; ++s) {
+      for (std::size_t c = 0; c + s < x.length; c += R) {
+	std::size_t b = c;
+	std::size_t e = c;
+	while (e + s < x.length && e - b < R && X[e] == X[e + s]) {
+	  ++e;
+	}
+	while (b > 0 && e - b < R && X[b - 1] == X[b - 1 + s]) {
+	  --b;
+	}
+	if (e - b >= R) {
+	  return false;
+	}
+      }
+    }
+    return true;
+  }
+
+public:
+  VariantDistance()
+    : row(), next(), anchors(), gaps(), merged(), compared(0), jumped(0)
+  { }
+
+  /// Edit distance between A and B, two haplotypes of the same backbone
+  /// (or any two haplotypes, the result is exact in any case).
+  std::size_t
+  operator()(const Haplotype& A, const Haplotype& B)
+  {
+    compared = 0;
+    jumped = 0;
+    find_anchors(A, B);
+    gaps.resize(anchors.size() + 1);
+    merged.assign(anchors.size() + 1, false);
+    for (std::size_t g = 0; g < gaps.size(); ++g) {
+      gaps[g] = gap_distance(A, B, g);
+    }
+    // drop the anchors that do not force the alignment, merging the
+    // gaps around them; the distance of a merged gap is at most the sum
+    // of its parts, which is used for u until no anchor is dropped
+    for (bool dropped = true; dropped; ) {
+      dropped = false;
+      std::size_t kept = 0;
+      std::size_t open = gaps[0];
+      bool open_merged = merged[0];
+      for (std::size_t x = 0; x < anchors.size(); ++x) {
+	if (forced(anchors[x], open + gaps[x+1])) {
+	  gaps[kept] = open;
+	  merged[kept] = open_merged;
+	  anchors[kept++] = anchors[x];
+	  open = gaps[x+1];
+	  open_merged = merged[x+1];
+	} else {
+	  open += gaps[x+1];
+	  open_merged = true;
+	  dropped = true;
+	}
+      }
+      gaps[kept] = open;
+      merged[kept] = open_merged;
+      anchors.resize(kept);
+      gaps.resize(kept + 1);
+      merged.resize(kept + 1);
+    }
+    for (std::size_t g = 0; g < gaps.size(); ++g) {
+      if (merged[g]) {
+	gaps[g] = gap_distance(A, B, g);
+      }
+    }
+    std::size_t d = 0;
+    for (std::size_t g : gaps) {
+      d += g;
+    }
+    return d;
+  }
+
+  /// Number of anchors the last call was cut at.
+  std::size_t anchor_count() const { return anchors.size(); }
+
+  /// Symbols matched one by one and skipped over shared backbone
+  /// stretches by the last call.
+  std::size_t symbols_compared() const { return compared; }
+  std::size_t symbols_jumped() const { return jumped; }
+};
+
+/// Edit distance between variants i and j of 'evg'.
+inline std::size_t
+variant_distance(const EditVars& evg, std::size_t i, std::size_t j)
+{
+  Haplotype a(evg.backbone_sequence(), evg.variant(i).variation_list());
+  Haplotype b(evg.backbone_sequence(), evg.variant(j).variation_list());
+  return VariantDistance()(a, b);
+}
+
+/// Edit distance between variant i of 'evg' and the backbone.
+inline std::size_t
+backbone_distance(const EditVars& evg, std::size_t i)
+{
+  Haplotype a(evg.backbone_sequence(), evg.variant(i).variation_list());
+  Haplotype b(evg.backbone_sequence(), VariantStore());
+  return VariantDistance()(a, b);
+}
+
+#endif
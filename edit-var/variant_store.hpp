@@ -0,0 +1,400 @@
+// variant_store.hpp
+
+// Copyright 2020 Michele Schimd
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RES_SW_VARIANT_STORE_HPP
+#define RES_SW_VARIANT_STORE_HPP
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "variation_type.hpp"
+
+/// One variation read from a VariantStore. For substitutions and
+/// insertions 'data' points to the 'length' new symbols, for
+/// deletions it is null and 'length' is the number of deleted symbols.
+struct VariantRecord
+{
+  std::uint64_t position;
+  int           type;
+  std::uint32_t length;
+  const char*   data;
+
+  /// End (excluded) of the backbone interval affected.
+  std::uint64_t end() const
+  {
+    return position + (type == InsertionType ? 0 : length);
+  }
+};
+
+/// Columnar store of the (sorted) variations of one sample.
+///
+/// Variations are kept as struct of arrays: position deltas (32 bits),
+/// type (8 bits) and length (32 bits); the symbols of substitutions
+/// and insertions are appended to a single pool and deletions only
+/// store their length. Variations are grouped in blocks of BlockSize:
+/// each block has a checkpoint with its absolute first position, its
+/// offset in the pool and the maximum end of all the variations up to
+/// the block (non decreasing), which is the interval index used by
+/// query() to find the first variation overlapping a region.
+///
+/// A store is either built in memory with append() or mapped (mmap)
+/// from a file written by save(). The file layout (host byte order) is
+///
+///   char[4]  magic "RSVS"
+///   uint32   version
+///   uint64   number of variations
+///   uint64   number of blocks
+///   uint64   size of the pool
+///   uint32[] position deltas (from the block checkpoint)
+///   uint8[]  types
+///   uint32[] lengths
+///   uint64[] blocks (position, pool offset, max end)
+///   char[]   pool
+///
+/// each array zero padded to a multiple of 8 bytes.
+class VariantStore
+{
+public:
+  static constexpr std::size_t BlockSize = 64;
+
+private:
+  static constexpr std::uint32_t Version = 1;
+  static constexpr std::size_t   HeaderBytes = 32;
+
+  // only used for stores built in memory
+  std::vector<std::uint32_t> own_delta;
+  std::vector<std::uint8_t>  own_type;
+  std::vector<std::uint32_t> own_length;
+  std::vector<std::uint64_t> own_blocks;
+  std::string                own_pool;
+  // only used for mapped stores
+  void*                      map_addr;
+  std::size_t                map_len;
+
+  const std::uint32_t*       delta;
+  const std::uint8_t*        types;
+  const std::uint32_t*       lengths;
+  const std::uint64_t*       blocks;
+  const char*                pool;
+  std::size_t                count;
+  std::size_t                n_blocks;
+  std::size_t                pool_size;
+  // last appended position (append only)
+  std::uint64_t              last_pos;
+
+  static std::size_t pad8(std::size_t b) { return (b + 7) / 8 * 8; }
+
+  void
+  refresh()
+  {
+    delta = own_delta.data();
+    types = own_type.data();
+    lengths = own_length.data();
+    blocks = own_blocks.data();
+    pool = own_pool.data();
+    count = own_delta.size();
+    n_blocks = own_blocks.size() / 3;
+    pool_size = own_pool.size();
+  }
+
+  void
+  release()
+  {
+    if (map_addr != nullptr) {
+      munmap(map_addr, map_len);
+      map_addr = nullptr;
+    }
+  }
+
+  /// Visits the variations from the beginning of block 'b' while
+  /// visit(record) returns true.
+  template <typename F_>
+  void
+  scan(std::size_t b, F_ visit) const
+  {
+    for (; b < n_blocks; ++b) {
+      std::uint64_t pos = blocks[3*b];
+      std::uint64_t off = blocks[3*b+1];
+      std::size_t last = std::min(count, (b+1) * BlockSize);
+      for (std::size_t i = b * BlockSize; i < last; ++i) {
+	VariantRecord r {pos + delta[i], types[i], lengths[i], nullptr};
+	if (r.type != DeletionType) {
+	  r.data = pool + off;
+	  off += r.length;
+	}
+	if (!visit(r)) {
+	  return;
+	}
+      }
+    }
+  }
+
+public:
+  VariantStore()
+    : own_delta(), own_type(), own_length(), own_blocks(), own_pool(),
+      map_addr(nullptr), map_len(0), delta(nullptr), types(nullptr),
+      lengths(nullptr), blocks(nullptr), pool(nullptr), count(0),
+      n_blocks(0), pool_size(0), last_pos(0)
+  { }
+
+  /// Copies are always built in memory (also from mapped stores).
+  VariantStore(const VariantStore& o)
+    : VariantStore()
+  {
+    o.for_each([this](const VariantRecord& r) {
+	append(r.position, r.type, r.length, r.data);
+      });
+  }
+
+  VariantStore&
+  operator=(const VariantStore& o)
+  {
+    if (this != &o) {
+      *this = VariantStore(o);
+    }
+    return *this;
+  }
+
+  VariantStore(VariantStore&& o)
+    : VariantStore()
+  {
+    *this = std::move(o);
+  }
+
+  VariantStore&
+  operator=(VariantStore&& o)
+  {
+    release();
+    bool own = (o.map_addr == nullptr);
+    own_delta = std::move(o.own_delta);
+    own_type = std::move(o.own_type);
+    own_length = std::move(o.own_length);
+    own_blocks = std::move(o.own_blocks);
+    own_pool = std::move(o.own_pool);
+    map_addr = o.map_addr;
+    map_len = o.map_len;
+    if (own) {
+      refresh();
+    } else {
+      delta = o.delta;
+      types = o.types;
+      lengths = o.lengths;
+      blocks = o.blocks;
+      pool = o.pool;
+      count = o.count;
+      n_blocks = o.n_blocks;
+      pool_size = o.pool_size;
+    }
+    last_pos = o.last_pos;
+    o.map_addr = nullptr;
+    o.count = 0;
+    o.n_blocks = 0;
+    o.pool_size = 0;
+    return *this;
+  }
+
+  ~VariantStore() { release(); }
+
+  /// Appends a variation, positions must be non decreasing. For
+  /// deletions 'data' is ignored (may be null).
+  void
+  append(std::uint64_t position, int type, std::uint32_t length,
+	 const char* data)
+  {
+    if (map_addr != nullptr) {
+      throw std::logic_error("VariantStore: mapped stores are read only");
+    }
+    if (count > 0 && position < last_pos) {
+      throw std::invalid_argument("VariantStore: unsorted variations");
+    }
+    if (count % BlockSize == 0) {
+      std::uint64_t prev_end = own_blocks.empty() ? 0 : own_blocks.back();
+      own_blocks.push_back(position);
+      own_blocks.push_back(own_pool.size());
+      own_blocks.push_back(prev_end);
+    }
+    std::uint64_t d = position - own_blocks[own_blocks.size() - 3];
+    if (d > std::numeric_limits<std::uint32_t>::max()) {
+      throw std::overflow_error("VariantStore: position delta too large");
+    }
+    own_delta.push_back(static_cast<std::uint32_t>(d));
+    own_type.push_back(static_cast<std::uint8_t>(type));
+    own_length.push_back(length);
+    if (type != DeletionType) {
+      own_pool.append(data, length);
+    }
+    // insertions (empty interval) are indexed as [position, position+1)
+    std::uint64_t end = position + std::max<std::uint64_t>(
+      type == InsertionType ? 0 : length, 1);
+    own_blocks.back() = std::max(own_blocks.back(), end);
+    last_pos = position;
+    refresh();
+  }
+
+  /// Appends a Variation (anything with position(), type(), length()
+  /// and variation()), positions must be non decreasing.
+  template <typename VarT_>
+  void
+  push_back(const VarT_& var)
+  {
+    const auto w = var.variation();
+    append(var.position(), var.type(),
+	   static_cast<std::uint32_t>(var.length()), w.data());
+  }
+
+  /// Builds a store from a (sorted) VariationList.
+  template <typename ListT_>
+  static VariantStore
+  from_variation_list(const ListT_& v)
+  {
+    VariantStore s;
+    for (const auto& var : v) {
+      s.push_back(var);
+    }
+    return s;
+  }
+
+  /// Maps a file written by save(), throws std::runtime_error if the
+  /// file cannot be mapped or is not a variant store.
+  static VariantStore
+  map_file(const std::string& path)
+  {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("Cannot open " + path);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 ||
+	static_cast<std::size_t>(st.st_size) < HeaderBytes) {
+      close(fd);
+      throw std::runtime_error("Invalid variant store " + path);
+    }
+    std::size_t len = static_cast<std::size_t>(st.st_size);
+    void* addr = mmap(nullptr, len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+      throw std::runtime_error("Cannot map " + path);
+    }
+    VariantStore s;
+    s.map_addr = addr;
+    s.map_len = len;
+    const char* p = static_cast<const char*>(addr);
+    std::uint32_t version;
+    std::uint64_t n, nb, ps;
+    std::memcpy(&version, p + 4, 4);
+    std::memcpy(&n, p + 8, 8);
+    std::memcpy(&nb, p + 16, 8);
+    std::memcpy(&ps, p + 24, 8);
+    std::size_t o_type = HeaderBytes + pad8(4*n);
+    std::size_t o_len = o_type + pad8(n);
+    std::size_t o_blocks = o_len + pad8(4*n);
+    std::size_t o_pool = o_blocks + 24*nb;
+    if (std::memcmp(p, "RSVS", 4) != 0 || version != Version ||
+	o_pool + ps > len || nb != (n + BlockSize - 1) / BlockSize) {
+      throw std::runtime_error("Invalid variant store " + path);
+    }
+    s.delta = reinterpret_cast<const std::uint32_t*>(p + HeaderBytes);
+    s.types = reinterpret_cast<const std::uint8_t*>(p + o_type);
+    s.lengths = reinterpret_cast<const std::uint32_t*>(p + o_len);
+    s.blocks = reinterpret_cast<const std::uint64_t*>(p + o_blocks);
+    s.pool = p + o_pool;
+    s.count = n;
+    s.n_blocks = nb;
+    s.pool_size = ps;
+    return s;
+  }
+
+  /// Writes the store in the format read by map_file().
+  void
+  save(const std::string& path) const
+  {
+    std::ofstream os(path, std::ios::binary);
+    std::uint32_t version = Version;
+    std::uint64_t n = count, nb = n_blocks, ps = pool_size;
+    const char zeros[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+    os.write("RSVS", 4);
+    os.write(reinterpret_cast<const char*>(&version), 4);
+    os.write(reinterpret_cast<const char*>(&n), 8);
+    os.write(reinterpret_cast<const char*>(&nb), 8);
+    os.write(reinterpret_cast<const char*>(&ps), 8);
+    os.write(reinterpret_cast<const char*>(delta), 4*n);
+    os.write(zeros, pad8(4*n) - 4*n);
+    os.write(reinterpret_cast<const char*>(types), n);
+    os.write(zeros, pad8(n) - n);
+    os.write(reinterpret_cast<const char*>(lengths), 4*n);
+    os.write(zeros, pad8(4*n) - 4*n);
+    os.write(reinterpret_cast<const char*>(blocks), 24*nb);
+    os.write(pool, ps);
+    if (!os) {
+      throw std::runtime_error("Cannot write " + path);
+    }
+  }
+
+  std::size_t size() const { return count; }
+
+  std::size_t pool_bytes() const { return pool_size; }
+
+  /// Calls visit(const VariantRecord&) for every variation in order.
+  template <typename F_>
+  void
+  for_each(F_ visit) const
+  {
+    scan(0, [&visit](const VariantRecord& r) { visit(r); return true; });
+  }
+
+  /// Calls visit(const VariantRecord&) for the variations overlapping
+  /// the backbone interval [b, e) (insertions at b..e-1 included), in
+  /// order. Blocks ending before b are skipped with the interval index.
+  template <typename F_>
+  void
+  query(std::uint64_t b, std::uint64_t e, F_ visit) const
+  {
+    // first block whose max end (over all previous blocks) exceeds b
+    std::size_t lo = 0;
+    std::size_t hi = n_blocks;
+    while (lo < hi) {
+      std::size_t mid = (lo + hi) / 2;
+      if (blocks[3*mid+2] <= b) {
+	lo = mid + 1;
+      } else {
+	hi = mid;
+      }
+    }
+    scan(lo, [&](const VariantRecord& r) {
+	if (r.position >= e) {
+	  return false;
+	}
+	if (r.end() > b || (r.type == InsertionType && r.position >= b)) {
+	  visit(r);
+	}
+	return true;
+      });
+  }
+};
+
+#endif
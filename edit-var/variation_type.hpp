@@ -0,0 +1,25 @@
+// variation_type.hpp
+
+// Copyright 2020 Michele Schimd
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RES_SW_VARIATION_TYPE_HPP
+#define RES_SW_VARIATION_TYPE_HPP
+
+// These are the type of variation as int
+constexpr int SubstitutionType = 1;
+constexpr int InsertionType    = 2;
+constexpr int DeletionType     = 3;
+
+#endif
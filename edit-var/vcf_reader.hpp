@@ -0,0 +1,346 @@
+// vcf_reader.hpp
+
+// Copyright 2020 Michele Schimd
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RES_SW_VCF_READER_HPP
+#define RES_SW_VCF_READER_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "edit_var.hpp"
+#include "variant_store.hpp"
+
+// Streaming VCF ingestion: the file is read in chunks cut at line
+// boundaries, chunks are parsed by a pool of threads and the parsed
+// variations are merged in file order into one VariantStore per
+// haplotype (sample and genotype slot). Only 'threads' chunks of raw
+// text are in memory at any time.
+
+/// A variation parsed from a chunk, 'offset' refers to the chunk pool.
+struct VcfVariation
+{
+  std::uint64_t position;
+  int           type;
+  std::uint32_t length;
+  std::size_t   offset;
+};
+
+/// Variations of one chunk, per haplotype and in file order.
+struct VcfChunk
+{
+  std::vector<std::vector<VcfVariation>> haps;
+  std::string                            pool;
+  std::size_t                            records;
+};
+
+class VcfReader
+{
+private:
+  std::ifstream            is;
+  std::string              chrom;
+  std::size_t              threads;
+  std::size_t              chunk_size;
+  std::size_t              ploidy;
+  std::vector<std::string> names;
+  // data read after the header
+  std::string              pending;
+  std::size_t              n_records;
+  std::size_t              n_skipped;
+
+  using Field = std::pair<const char*, std::size_t>;
+
+  static bool
+  same(const Field& f, const std::string& s)
+  {
+    return f.second == s.size() && std::memcmp(f.first, s.data(), f.second) == 0;
+  }
+
+  static std::uint64_t
+  parse_uint(const Field& f)
+  {
+    std::uint64_t v = 0;
+    for (std::size_t i = 0; i < f.second; ++i) {
+      v = 10*v + static_cast<std::uint64_t>(f.first[i] - '0');
+    }
+    return v;
+  }
+
+  /// Variations turning ref (at 0-based p) into alt, after removing
+  /// the common prefix and suffix; the symbols go to 'pool'.
+  static void
+  allele_variations(std::uint64_t p, const char* ref, std::size_t rl,
+		    const char* alt, std::size_t al, std::string& pool,
+		    std::vector<VcfVariation>& out)
+  {
+    std::size_t pre = 0;
+    while (pre < rl && pre < al && ref[pre] == alt[pre]) {
+      ++pre;
+    }
+    std::size_t suf = 0;
+    while (suf < rl - pre && suf < al - pre &&
+	   ref[rl-1-suf] == alt[al-1-suf]) {
+      ++suf;
+    }
+    p += pre;
+    ref += pre;
+    alt += pre;
+    rl -= pre + suf;
+    al -= pre + suf;
+    std::size_t k = std::min(rl, al);
+    if (k > 0) {
+      out.push_back(VcfVariation{p, SubstitutionType,
+	    static_cast<std::uint32_t>(k), pool.size()});
+      pool.append(alt, k);
+    }
+    if (al > k) {
+      out.push_back(VcfVariation{p + k, InsertionType,
+	    static_cast<std::uint32_t>(al - k), pool.size()});
+      pool.append(alt + k, al - k);
+    }
+    if (rl > k) {
+      out.push_back(VcfVariation{p + k, DeletionType,
+	    static_cast<std::uint32_t>(rl - k), 0});
+    }
+  }
+
+  /// Parses the complete lines in [b, e).
+  void
+  parse_chunk(const char* b, const char* e, VcfChunk& out) const
+  {
+    out.haps.assign(names.size(), std::vector<VcfVariation>());
+    out.pool.clear();
+    out.records = 0;
+    std::vector<Field> fields;
+    std::vector<std::vector<VcfVariation>> alt_vars;
+    while (b < e) {
+      const char* eol = static_cast<const char*>(std::memchr(b, '\n', e - b));
+      if (eol == nullptr) {
+	eol = e;
+      }
+      const char* l = b;
+      const char* le = (eol > b && eol[-1] == '\r') ? eol - 1 : eol;
+      b = eol + 1;
+      if (l == le || *l == '#') {
+	continue;
+      }
+      fields.clear();
+      for (const char* f = l; f <= le; ) {
+	const char* t = static_cast<const char*>(std::memchr(f, '\t', le - f));
+	if (t == nullptr) {
+	  t = le;
+	}
+	fields.emplace_back(f, t - f);
+	f = t + 1;
+      }
+      if (fields.size() < 8 || (!chrom.empty() && !same(fields[0], chrom))) {
+	continue;
+      }
+      ++out.records;
+      std::uint64_t p = parse_uint(fields[1]) - 1;
+      const Field& ref = fields[3];
+      // variations of each alternative allele, computed once
+      alt_vars.clear();
+      const char* a = fields[4].first;
+      const char* ae = a + fields[4].second;
+      while (a <= ae) {
+	const char* c = static_cast<const char*>(std::memchr(a, ',', ae - a));
+	if (c == nullptr) {
+	  c = ae;
+	}
+	alt_vars.emplace_back();
+	// symbolic, missing or spanning deletion alleles are ignored
+	bool plain = (c > a);
+	for (const char* q = a; q < c; ++q) {
+	  plain = plain && (*q == 'A' || *q == 'C' || *q == 'G' || *q == 'T' ||
+			    *q == 'N' || *q == 'a' || *q == 'c' || *q == 'g' ||
+			    *q == 't' || *q == 'n');
+	}
+	if (plain) {
+	  allele_variations(p, ref.first, ref.second, a, c - a, out.pool,
+			    alt_vars.back());
+	}
+	a = c + 1;
+      }
+      // genotypes: GT is the first key of FORMAT
+      for (std::size_t s = 0; s + 9 < fields.size() && s * ploidy < names.size();
+	   ++s) {
+	const char* g = fields[9 + s].first;
+	const char* ge = g + fields[9 + s].second;
+	std::size_t h = 0;
+	while (g < ge && *g != ':' && h < ploidy) {
+	  if (*g >= '0' && *g <= '9') {
+	    std::size_t k = 0;
+	    while (g < ge && *g >= '0' && *g <= '9') {
+	      k = 10*k + static_cast<std::size_t>(*g - '0');
+	      ++g;
+	    }
+	    if (k > 0 && k <= alt_vars.size()) {
+	      auto& hv = out.haps[s * ploidy + h];
+	      hv.insert(hv.end(), alt_vars[k-1].begin(), alt_vars[k-1].end());
+	    }
+	  } else if (*g == '|' || *g == '/') {
+	    ++h;
+	    ++g;
+	  } else {
+	    // missing allele '.'
+	    ++g;
+	  }
+	}
+      }
+    }
+  }
+
+  /// Reads the header up to the #CHROM line (sample names).
+  void
+  read_header()
+  {
+    std::string line;
+    while (std::getline(is, line)) {
+      if (line.compare(0, 2, "##") == 0) {
+	continue;
+      }
+      if (line.compare(0, 6, "#CHROM") != 0) {
+	throw std::runtime_error("VCF: missing #CHROM header line");
+      }
+      if (!line.empty() && line.back() == '\r') {
+	line.pop_back();
+      }
+      std::vector<std::string> cols;
+      std::size_t b = 0;
+      while (b <= line.size()) {
+	std::size_t t = line.find('\t', b);
+	if (t == std::string::npos) {
+	  t = line.size();
+	}
+	cols.push_back(line.substr(b, t - b));
+	b = t + 1;
+      }
+      for (std::size_t c = 9; c < cols.size(); ++c) {
+	for (std::size_t h = 0; h < ploidy; ++h) {
+	  names.push_back(cols[c] + "_" + std::to_string(h));
+	}
+      }
+      return;
+    }
+    throw std::runtime_error("VCF: missing #CHROM header line");
+  }
+
+public:
+  /// Opens the VCF at 'path' and reads its header. Only records of
+  /// 'chrom' are loaded (all if empty); each sample contributes
+  /// 'ploidy' haplotypes.
+  VcfReader(const std::string& path, const std::string& chrom_ = "",
+	    std::size_t threads_ = 1, std::size_t ploidy_ = 2,
+	    std::size_t chunk_size_ = std::size_t(1) << 24)
+    : is(path, std::ios::binary), chrom(chrom_),
+      threads(std::max<std::size_t>(1, threads_)),
+      chunk_size(std::max<std::size_t>(1 << 16, chunk_size_)),
+      ploidy(std::max<std::size_t>(1, ploidy_)), names(), pending(),
+      n_records(0), n_skipped(0)
+  {
+    if (!is) {
+      throw std::runtime_error("Cannot open " + path);
+    }
+    read_header();
+  }
+
+  /// Names of the haplotypes (sample_slot), in the order of read().
+  const std::vector<std::string>& haplotype_names() const { return names; }
+
+  std::size_t records() const { return n_records; }
+
+  /// Variations dropped because they overlap a previous variation of
+  /// the same haplotype.
+  std::size_t skipped() const { return n_skipped; }
+
+  /// Reads all the records, one store per haplotype.
+  std::vector<VariantStore>
+  read()
+  {
+    std::vector<VariantStore> stores(names.size());
+    // end of the last variation of each haplotype
+    std::vector<std::uint64_t> last_end(names.size(), 0);
+    std::vector<std::string> text(threads);
+    std::vector<VcfChunk> chunks(threads);
+    std::string carry;
+    bool eof = false;
+    while (!eof) {
+      // read up to 'threads' chunks cut at line boundaries
+      std::size_t round = 0;
+      for (; round < threads && !eof; ++round) {
+	std::string& t = text[round];
+	t.swap(carry);
+	std::size_t old = t.size();
+	t.resize(old + chunk_size);
+	is.read(&t[old], static_cast<std::streamsize>(chunk_size));
+	t.resize(old + static_cast<std::size_t>(is.gcount()));
+	eof = !is;
+	std::size_t cut = eof ? t.size() : t.rfind('\n') + 1;
+	carry.assign(t, cut, std::string::npos);
+	t.resize(cut);
+      }
+      auto worker = [&](std::size_t c) {
+	parse_chunk(text[c].data(), text[c].data() + text[c].size(), chunks[c]);
+      };
+      std::vector<std::thread> pool;
+      for (std::size_t c = 1; c < round; ++c) {
+	pool.emplace_back(worker, c);
+      }
+      worker(0);
+      for (auto& th : pool) {
+	th.join();
+      }
+      // merge in file order, keeping each haplotype sorted
+      for (std::size_t c = 0; c < round; ++c) {
+	n_records += chunks[c].records;
+	for (std::size_t h = 0; h < names.size(); ++h) {
+	  for (const VcfVariation& v : chunks[c].haps[h]) {
+	    if (v.position < last_end[h]) {
+	      ++n_skipped;
+	      continue;
+	    }
+	    stores[h].append(v.position, v.type, v.length,
+			     chunks[c].pool.data() + v.offset);
+	    last_end[h] = v.position + (v.type == InsertionType ? 0 : v.length);
+	  }
+	}
+      }
+    }
+    return stores;
+  }
+};
+
+/// EditVars over 'backbone' with one SequenceVariant per store, tagged
+/// with the index of the store. The stores are moved in the variants.
+inline EditVars
+make_edit_vars(const std::string& backbone, std::vector<VariantStore> stores)
+{
+  EditVars evg {backbone};
+  for (std::size_t i = 0; i < stores.size(); ++i) {
+    evg.add_variant(make_sequence_variant(std::move(stores[i]),
+					  static_cast<int>(i)));
+  }
+  return evg;
+}
+
+#endif
@@ -20,9 +20,24 @@
 #include <str/kmer.hpp>
 #include <btl/io.hpp>
 
+#include <bit_parallel_ed.hpp>
+#include <batched_ed.hpp>
+#include <banded_ed.hpp>
+#include <packed_genome.hpp>
+
+#include "ged_output.hpp"
+#include "ged_stats.hpp"
+
 #include <iostream>
 #include <random>
 #include <map>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <chrono>
+#include <memory>
 
 /// This software takes as input a genome in the fasta format and
 /// produces as output a csv file that contains N lines. Each line
@@ -40,11 +55,28 @@ struct Options
   std::size_t read_length;
   std::size_t read_count;
   std::size_t read_overlap;
+  // overlap sweep (enabled when s_min or s_max is given)
+  bool        sweep;
+  std::size_t overlap_min;
+  std::size_t overlap_max;
+  // distances among all the N substrings (condensed matrix output)
+  bool        all_vs_all;
+  std::size_t threads;
+  unsigned    seed;
+  std::string algorithm;
+  std::size_t threshold;
+  std::string output;
+  // 1 genome and timing, 2 options, 3 JSON summary of the stages
   int         verbosity;
+  // seconds between progress lines (0 disables them)
+  double      progress;
 
   Options(int argc, char** argv)
     : fasta_path {""}, read_length {10}, read_count {1},
-      read_overlap {0}, verbosity {0}
+      read_overlap {0}, sweep {false}, overlap_min {1}, overlap_max {0},
+      all_vs_all {false}, threads {1}, seed {std::random_device()()},
+      algorithm {"wf"}, threshold {NoThreshold},
+      output {""}, verbosity {0}, progress {0}
   {
     // when only one paramter is given it assumed to be a key=value
     // file, otherwise there is a specific order in which parameters
@@ -69,9 +101,40 @@ struct Options
       if (kv_map.find("s") != it_end) {
 	read_overlap = ctl::from_string<std::size_t>(kv_map["s"]);
       }
+      if (kv_map.find("s_min") != it_end) {
+	sweep = true;
+	overlap_min = ctl::from_string<std::size_t>(kv_map["s_min"]);
+      }
+      if (kv_map.find("s_max") != it_end) {
+	sweep = true;
+	overlap_max = ctl::from_string<std::size_t>(kv_map["s_max"]);
+      } else {
+	overlap_max = read_length - 1;
+      }
+      if (kv_map.find("all_vs_all") != it_end) {
+	all_vs_all = ctl::from_string<int>(kv_map["all_vs_all"]) != 0;
+      }
+      if (kv_map.find("threads") != it_end) {
+	threads = ctl::from_string<std::size_t>(kv_map["threads"]);
+      }
+      if (kv_map.find("seed") != it_end) {
+	seed = ctl::from_string<unsigned>(kv_map["seed"]);
+      }
+      if (kv_map.find("algorithm") != it_end) {
+	algorithm = kv_map["algorithm"];
+      }
+      if (kv_map.find("k") != it_end) {
+	threshold = ctl::from_string<std::size_t>(kv_map["k"]);
+      }
+      if (kv_map.find("output") != it_end) {
+	output = kv_map["output"];
+      }
       if(kv_map.find("verbosity") != it_end) {
 	verbosity = ctl::from_string<int>(kv_map["verbosity"]);
       }
+      if (kv_map.find("progress") != it_end) {
+	progress = ctl::from_string<double>(kv_map["progress"]);
+      }
       
     } else {
     
@@ -79,7 +142,7 @@ struct Options
       //arguments check and conversion
       if (argc < 3) {
 	std::cout << "Error in invocation\n";
-	std::cout << "Usage:\n\tged fasta [m N s]\n\n"; 
+	std::cout << "Usage:\n\tged fasta [m N s threads]\n\n"; 
 	exit(1);
       }
       fasta_path = argv[1];
@@ -90,6 +153,39 @@ struct Options
       if (argc >= 5) {
 	read_overlap = ctl::from_string<size_t>(std::string(argv[4]));
       }
+      if (argc >= 6) {
+	threads = ctl::from_string<size_t>(std::string(argv[5]));
+      }
+    }
+    if (threads == 0) {
+      threads = 1;
+    }
+    // the all-vs-all mode only writes the binary matrix
+    if (output.empty()) {
+      output = all_vs_all ? "binary" : "csv";
+    }
+    if (all_vs_all && output != "binary") {
+      std::cout << "All-vs-all mode only supports output=binary (matrix)\n";
+      exit(1);
+    }
+    if (output != "csv" && output != "stats" && output != "histogram"
+	&& output != "binary") {
+      std::cout << "Unknown output '" << output
+		<< "' (csv, stats, histogram, binary)\n";
+      exit(1);
+    }
+    if (sweep && (overlap_max >= read_length || overlap_min > overlap_max)) {
+      std::cout << "Overlap sweep requires s_min <= s_max < n\n";
+      exit(1);
+    }
+    if (all_vs_all && (sweep || read_overlap > 0)) {
+      std::cout << "All-vs-all mode does not support overlaps\n";
+      exit(1);
+    }
+    if (algorithm != "wf" && algorithm != "bitpar" && algorithm != "simd") {
+      std::cout << "Unknown algorithm '" << algorithm
+		<< "' (wf, bitpar, simd)\n";
+      exit(1);
     }
   }
 
@@ -100,8 +196,25 @@ struct Options
     os << "  File          " << fasta_path   << "\n";
     os << "  Read len   n= " << read_length  << "\n";
     os << "  Read count N= " << read_count   << "\n";
-    os << "  Overlap       " << read_overlap << "\n";
+    if (all_vs_all) {
+      os << "  All-vs-all    " << read_count * (read_count - 1) / 2
+	 << " pairs\n";
+    } else if (sweep) {
+      os << "  Overlaps      " << overlap_min << "-" << overlap_max << "\n";
+    } else {
+      os << "  Overlap       " << read_overlap << "\n";
+    }
+    os << "  Threads       " << threads      << "\n";
+    os << "  Seed          " << seed         << "\n";
+    os << "  Algorithm     " << algorithm    << "\n";
+    if (threshold != NoThreshold) {
+      os << "  Threshold  k= " << threshold    << "\n";
+    }
+    os << "  Output        " << output       << "\n";
     os << "  Verbosity     " << verbosity    << "\n";
+    if (progress > 0) {
+      os << "  Progress      " << progress     << " s\n";
+    }
     os << "\n";
   }
 };
@@ -143,78 +256,684 @@ random_overlapping_subsequences(const std::string& seq, size_t m, size_t w,
 //      a. Exact amount of overlap (>0)
 
 
+/// Number of pairs sampled with the same random stream. Each block
+/// has its own generator seeded with (seed, block index), so the
+/// sampled positions (and the output) only depend on the seed and not
+/// on the number of threads or on how blocks are scheduled.
+constexpr std::size_t PairBlockSize = 1024;
+
+/// Number of blocks per thread the workers can run ahead of the
+/// writer, this bounds the memory used for buffered results.
+constexpr std::size_t BlocksPerRound = 16;
+
+/// \brief DP cells computed by 'wf' for the last 'pairs' pairs of
+/// length m: the whole m x m matrix for the kernels that always
+/// compute it, the cells actually computed for the banded one.
+template <typename AlgED_>
+std::uint64_t
+computed_cells(AlgED_&, size_t pairs, size_t m)
+{
+  return static_cast<std::uint64_t>(pairs) * m * m;
+}
+
+inline std::uint64_t
+computed_cells(BandedED& wf, size_t, size_t)
+{
+  std::uint64_t cells = wf.computed_cells();
+  wf.reset_cells();
+  return cells;
+}
+
+/// \brief Evaluates the distance of all pairs in 'results' (whose
+/// positions are already set), one pair at the time. Copy and DP time
+/// go to 'stats' when it is not null.
+template <typename GenomeT_, typename AlgED_>
+void
+evaluate_block(const GenomeT_& genome, size_t m, AlgED_& wf,
+	       std::vector<PairResult>& results, StageStats* stats)
+{
+  StageTimer timer(stats);
+  std::string x, y;
+  for (PairResult& p : results) {
+    x.assign(genome.begin() + p.position1, genome.begin() + p.position1 + m);
+    y.assign(genome.begin() + p.position2, genome.begin() + p.position2 + m);
+    timer.lap(SampleStage);
+    p.distance = static_cast<size_t>(wf(x, y));
+    timer.lap(DpStage);
+  }
+}
+
+/// \brief Batched evaluation: pairs are packed BatchedED::lanes() at
+/// the time and evaluated together.
+template <typename GenomeT_>
+void
+evaluate_block(const GenomeT_& genome, size_t m, BatchedED& wf,
+	       std::vector<PairResult>& results, StageStats* stats)
+{
+  StageTimer timer(stats);
+  for (size_t i = 0; i < results.size(); i += wf.lanes()) {
+    size_t k = std::min(wf.lanes(), results.size() - i);
+    wf.clear();
+    for (size_t l = 0; l < k; ++l) {
+      wf.add(genome.begin() + results[i+l].position1,
+	     genome.begin() + results[i+l].position2);
+    }
+    timer.lap(SampleStage);
+    wf.compute();
+    timer.lap(DpStage);
+    for (size_t l = 0; l < k; ++l) {
+      results[i+l].distance = wf.distance(l);
+    }
+  }
+}
+
+/// \brief Samples and evaluates the pairs of block 'b' (pairs in
+/// [b*PairBlockSize, min(N, (b+1)*PairBlockSize)).
+template <typename GenomeT_, typename AlgED_>
+void
+compute_block(const GenomeT_& genome, size_t m, size_t N, size_t s,
+	      size_t b, unsigned seed, AlgED_& wf,
+	      std::vector<PairResult>& results, StageStats* stats)
+{
+  StageTimer timer(stats);
+  size_t slack = s>0 ? m-s : 0;
+  auto dist = std::uniform_int_distribution<size_t>(0, genome.size()-m-1-slack);
+  std::seed_seq seq {seed, static_cast<unsigned>(b),
+      static_cast<unsigned>(b >> 32)};
+  std::mt19937 rdev(seq);
+  size_t first = b * PairBlockSize;
+  size_t last = std::min(N, first + PairBlockSize);
+  results.clear();
+  for (size_t i = first; i < last; ++i) {
+    size_t p1 = dist(rdev);
+    size_t p2 = (s > 0) ? p1 + m - s : dist(rdev);
+    results.push_back({p1, p2, 0, s});
+  }
+  timer.lap(SampleStage);
+  evaluate_block(genome, m, wf, results, stats);
+  if (stats) {
+    stats->pairs += results.size();
+    stats->cells += computed_cells(wf, results.size(), m);
+  }
+}
+
+/// \brief Evaluates all the overlaps s_min <= s <= s_max of the
+/// substring at position p1, that is ED(genome[p1,p1+m),
+/// genome[p1+m-s,p1+2m-s)).
+template <typename GenomeT_, typename AlgED_>
+void
+evaluate_sweep(const GenomeT_& genome, size_t m, size_t p1, size_t s_min,
+	       size_t s_max, AlgED_& wf, std::vector<PairResult>& results,
+	       StageStats* stats)
+{
+  StageTimer timer(stats);
+  std::string x(genome.begin() + p1, genome.begin() + p1 + m);
+  std::string y;
+  for (size_t s = s_min; s <= s_max; ++s) {
+    size_t p2 = p1 + m - s;
+    y.assign(genome.begin() + p2, genome.begin() + p2 + m);
+    timer.lap(SampleStage);
+    results.push_back({p1, p2, static_cast<size_t>(wf(x, y)), s});
+    timer.lap(DpStage);
+  }
+}
+
+/// \brief With the bit-parallel algorithm the pattern (the encoding of
+/// the substring at p1) is built once and shared by all the shifts,
+/// texts are read directly from the genome.
+template <typename GenomeT_>
+void
+evaluate_sweep(const GenomeT_& genome, size_t m, size_t p1, size_t s_min,
+	       size_t s_max, BitParallelED& wf,
+	       std::vector<PairResult>& results, StageStats* stats)
+{
+  StageTimer timer(stats);
+  wf.set_pattern(genome.begin() + p1, genome.begin() + p1 + m);
+  for (size_t s = s_min; s <= s_max; ++s) {
+    size_t p2 = p1 + m - s;
+    results.push_back({p1, p2,
+	  wf.distance(genome.begin() + p2, genome.begin() + p2 + m), s});
+  }
+  timer.lap(DpStage);
+}
+
+/// \brief Samples the first positions of sweep block 'b' (positions
+/// in [b*block_size, min(N, (b+1)*block_size)) and evaluates all the
+/// overlaps for each of them.
+template <typename GenomeT_, typename AlgED_>
+void
+sweep_block(const GenomeT_& genome, size_t m, size_t N, size_t s_min,
+	    size_t s_max, size_t block_size, size_t b, unsigned seed,
+	    AlgED_& wf, std::vector<PairResult>& results, StageStats* stats)
+{
+  StageTimer timer(stats);
+  size_t slack = m - s_min;
+  auto dist = std::uniform_int_distribution<size_t>(0, genome.size()-m-1-slack);
+  std::seed_seq seq {seed, static_cast<unsigned>(b),
+      static_cast<unsigned>(b >> 32)};
+  std::mt19937 rdev(seq);
+  size_t first = b * block_size;
+  size_t last = std::min(N, first + block_size);
+  results.clear();
+  for (size_t i = first; i < last; ++i) {
+    size_t p1 = dist(rdev);
+    timer.lap(SampleStage);
+    evaluate_sweep(genome, m, p1, s_min, s_max, wf, results, stats);
+    timer.restart();
+  }
+  if (stats) {
+    stats->pairs += results.size();
+    stats->cells += computed_cells(wf, results.size(), m);
+  }
+}
+
+/// \brief Runs 'blocks' blocks on 'threads' workers, each with its
+/// own algorithm instance from 'make_alg', and calls 'emit' on the
+/// results of every block in block order.
+///
+/// The workers are started once and take blocks from a shared counter;
+/// results go to a ring of threads*BlocksPerRound slots (block b uses
+/// slot b % slots), so a worker waits only when it is that many blocks
+/// ahead of the writer, which bounds the memory of buffered results.
+/// The calling thread is the writer. With a 'monitor' every slot
+/// collects the stage stats of its block, merged when it is emitted.
+template <typename AlgFactory_, typename BlockF_, typename EmitF_>
+void
+run_blocks(size_t blocks, size_t threads, AlgFactory_ make_alg,
+	   BlockF_ block, EmitF_ emit, RunMonitor* monitor)
+{
+  const size_t slots = std::min(blocks, threads * BlocksPerRound);
+  std::vector<std::vector<PairResult>> results(slots);
+  std::vector<StageStats> stats(slots);
+  // slot s holds block b when ready[s] == b+1, and can be filled with
+  // block b when free_for[s] == b
+  std::vector<size_t> ready(slots, 0);
+  std::vector<size_t> free_for(slots);
+  for (size_t s = 0; s < slots; ++s) {
+    free_for[s] = s;
+  }
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::atomic<size_t> next {0};
+
+  auto worker = [&]() {
+    auto wf = make_alg();
+    for (size_t b = next++; b < blocks; b = next++) {
+      size_t s = b % slots;
+      {
+	std::unique_lock<std::mutex> lock(mtx);
+	cv.wait(lock, [&]() { return free_for[s] == b; });
+      }
+      block(b, wf, results[s], monitor ? &stats[s] : nullptr);
+      {
+	std::lock_guard<std::mutex> lock(mtx);
+	ready[s] = b + 1;
+      }
+      cv.notify_all();
+    }
+  };
+  auto write = [&](size_t b) {
+    size_t s = b % slots;
+    if (monitor) {
+      monitor->merge(stats[s]);
+      stats[s] = StageStats();
+    }
+    StageTimer timer(monitor ? monitor->main_stats() : nullptr);
+    emit(results[s]);
+    timer.lap(OutputStage);
+    if (monitor) {
+      monitor->emitted_pairs(results[s].size());
+    }
+  };
+
+  if (threads == 1) {
+    auto wf = make_alg();
+    for (size_t b = 0; b < blocks; ++b) {
+      block(b, wf, results[b % slots], monitor ? &stats[b % slots] : nullptr);
+      write(b);
+    }
+    return;
+  }
+  std::vector<std::thread> pool;
+  for (size_t t = 0; t < threads; ++t) {
+    pool.emplace_back(worker);
+  }
+  for (size_t b = 0; b < blocks; ++b) {
+    size_t s = b % slots;
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      cv.wait(lock, [&]() { return ready[s] == b + 1; });
+    }
+    write(b);
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      free_for[s] = b + slots;
+    }
+    cv.notify_all();
+  }
+  for (auto& th : pool) {
+    th.join();
+  }
+}
+
 /// \brief Computes edit distane between several pairs of substrings
 /// of a given string (the 'genome').
 ///
+/// Pairs are split in blocks of PairBlockSize which are evaluated by
+/// 'threads' workers, each with its own instance of the edit distance
+/// algorithm. Output lines always follow the block order, therefore
+/// the output is deterministic for a given seed.
+///
 /// \param genome the string to produces substrings.
 /// \param m the length of the substrings.
 /// \param N the number of pairs of substrings.
 /// \param s the overlap between pairs (when 0 pairs are ranodmly generate)
-/// \param wf the edit distance algorithm.
-/// \param rdev
-/// \param out
+/// \param threads the number of worker threads.
+/// \param seed the seed of the random streams.
+/// \param make_alg factory returning a new edit distance algorithm.
+/// \param writer receives the results (see ged_output.hpp).
+/// \param monitor collects stage times and counters (null to disable).
 /// \param header
 
-template <typename AlgED_, typename RandD_, typename OutT_>
+template <typename GenomeT_, typename AlgFactory_, typename WriterT_>
 void
-compute(const std::string& genome, size_t m, size_t N, size_t s,
-	AlgED_& wf,  RandD_& rdev, OutT_& out, bool header = true)
+compute(const GenomeT_& genome, size_t m, size_t N, size_t s,
+	size_t threads, unsigned seed, AlgFactory_ make_alg,
+	WriterT_& writer, RunMonitor* monitor = nullptr, bool header = true)
+{
+  if (header) {
+    writer.header();
+  }
+  using AlgT = decltype(make_alg());
+  size_t blocks = (N + PairBlockSize - 1) / PairBlockSize;
+  auto block = [&](size_t b, AlgT& wf, std::vector<PairResult>& results,
+		   StageStats* stats) {
+    compute_block(genome, m, N, s, b, seed, wf, results, stats);
+  };
+  auto emit = [&](const std::vector<PairResult>& results) {
+    writer.write(results);
+  };
+  run_blocks(blocks, threads, make_alg, block, emit, monitor);
+  StageTimer timer(monitor ? monitor->main_stats() : nullptr);
+  writer.finish();
+  timer.lap(OutputStage);
+}
+
+/// \brief Overlap sweep: N first positions are sampled and, for each
+/// of them, the distance with all the substrings overlapping it by
+/// s_min, ..., s_max symbols is computed. The output has one line per
+/// (position, overlap) and replaces one run of compute() per overlap.
+///
+/// Parameters are the same of compute(), with the overlap range
+/// [s_min, s_max] (s_max < m) in place of s.
+template <typename GenomeT_, typename AlgFactory_, typename WriterT_>
+void
+compute_sweep(const GenomeT_& genome, size_t m, size_t N, size_t s_min,
+	      size_t s_max, size_t threads, unsigned seed,
+	      AlgFactory_ make_alg, WriterT_& writer,
+	      RunMonitor* monitor = nullptr, bool header = true)
 {
-  size_t slack = s>0 ? m-s : 0;
-  auto dist = std::uniform_int_distribution<>(0, genome.size()-m-1-slack);
   if (header) {
-    out << "position1,position2,distance\n";
+    writer.header();
   }
-  std::pair<std::string, size_t> p1, p2;
+  using AlgT = decltype(make_alg());
+  // keep roughly PairBlockSize pairs per block
+  size_t shifts = s_max - s_min + 1;
+  size_t block_size = std::max<size_t>(1, PairBlockSize / shifts);
+  size_t blocks = (N + block_size - 1) / block_size;
+  auto block = [&](size_t b, AlgT& wf, std::vector<PairResult>& results,
+		   StageStats* stats) {
+    sweep_block(genome, m, N, s_min, s_max, block_size, b, seed, wf, results,
+		stats);
+  };
+  auto emit = [&](const std::vector<PairResult>& results) {
+    writer.write(results);
+  };
+  run_blocks(blocks, threads, make_alg, block, emit, monitor);
+  StageTimer timer(monitor ? monitor->main_stats() : nullptr);
+  writer.finish();
+  timer.lap(OutputStage);
+}
+
+/// Side of the square tiles of the all-vs-all mode: the 2*AllTileSize
+/// substrings of a tile stay in cache while its pairs are evaluated.
+/// It is also the number of matrix rows computed (and buffered) at the
+/// time.
+constexpr std::size_t AllTileSize = 64;
+
+/// \brief Distances of the pairs (i, j), i in [i0,i1), j in [j0,j1)
+/// and j > i, stored in out[(i-i0)*stride + j-j0].
+template <typename AlgED_>
+void
+evaluate_tile(const std::vector<std::string>& seqs, size_t i0, size_t i1,
+	      size_t j0, size_t j1, AlgED_& wf, std::uint32_t* out,
+	      size_t stride)
+{
+  for (size_t i = i0; i < i1; ++i) {
+    for (size_t j = std::max(j0, i + 1); j < j1; ++j) {
+      out[(i-i0)*stride + j-j0] = static_cast<std::uint32_t>(wf(seqs[i], seqs[j]));
+    }
+  }
+}
+
+/// \brief With the bit-parallel algorithm the pattern of each row is
+/// built once per tile.
+inline void
+evaluate_tile(const std::vector<std::string>& seqs, size_t i0, size_t i1,
+	      size_t j0, size_t j1, BitParallelED& wf, std::uint32_t* out,
+	      size_t stride)
+{
+  for (size_t i = i0; i < i1; ++i) {
+    if (std::max(j0, i + 1) >= j1) {
+      continue;
+    }
+    wf.set_pattern(seqs[i]);
+    for (size_t j = std::max(j0, i + 1); j < j1; ++j) {
+      out[(i-i0)*stride + j-j0] = static_cast<std::uint32_t>(wf.distance(seqs[j]));
+    }
+  }
+}
+
+/// \brief Batched evaluation, the pairs of the tile fill the lanes in
+/// row major order.
+inline void
+evaluate_tile(const std::vector<std::string>& seqs, size_t i0, size_t i1,
+	      size_t j0, size_t j1, BatchedED& wf, std::uint32_t* out,
+	      size_t stride)
+{
+  std::vector<size_t> cells;
+  cells.reserve(wf.lanes());
+  auto flush = [&]() {
+    wf.compute();
+    for (size_t l = 0; l < cells.size(); ++l) {
+      out[cells[l]] = static_cast<std::uint32_t>(wf.distance(l));
+    }
+    wf.clear();
+    cells.clear();
+  };
+  wf.clear();
+  for (size_t i = i0; i < i1; ++i) {
+    for (size_t j = std::max(j0, i + 1); j < j1; ++j) {
+      wf.add(seqs[i].begin(), seqs[j].begin());
+      cells.push_back((i-i0)*stride + j-j0);
+      if (wf.full()) {
+	flush();
+      }
+    }
+  }
+  if (!cells.empty()) {
+    flush();
+  }
+}
+
+/// \brief All-vs-all mode: N substrings are sampled once and the
+/// distances of all the N(N-1)/2 pairs are written as a condensed
+/// upper triangular matrix (see MatrixWriter).
+///
+/// The matrix is computed in bands of AllTileSize rows; each band is
+/// split in AllTileSize x AllTileSize tiles which are taken by the
+/// 'threads' workers from a shared counter. When a band is complete
+/// its rows are written, so memory is O(N*AllTileSize) besides the N
+/// substrings. Parameters are the same of compute().
+template <typename GenomeT_, typename AlgFactory_, typename WriterT_>
+void
+compute_all(const GenomeT_& genome, size_t m, size_t N, size_t threads,
+	    unsigned seed, AlgFactory_ make_alg, WriterT_& writer,
+	    RunMonitor* monitor = nullptr)
+{
+  StageTimer main_timer(monitor ? monitor->main_stats() : nullptr);
+  auto dist = std::uniform_int_distribution<size_t>(0, genome.size()-m-1);
+  std::seed_seq seq {seed};
+  std::mt19937 rdev(seq);
+  std::vector<size_t> positions(N);
+  std::vector<std::string> seqs(N);
   for (size_t i = 0; i < N; ++i) {
-    p1 = random_subsequence_position(genome, m, dist, rdev);
-    if (s > 0) {
-      p2.second = p1.second + m - s;
-      p2.first = std::string(genome.begin() + p2.second,
-			     genome.begin() + p2.second + m);
+    positions[i] = dist(rdev);
+    seqs[i].assign(genome.begin() + positions[i],
+		   genome.begin() + positions[i] + m);
+  }
+  main_timer.lap(SampleStage);
+  writer.header(positions);
+  main_timer.lap(OutputStage);
+
+  const size_t T = AllTileSize;
+  std::vector<std::uint32_t> band;
+  std::vector<StageStats> stats(threads);
+  for (size_t I = 0; I < N; I += T) {
+    size_t I1 = std::min(N, I + T);
+    // columns [I, N) of rows [I, I1), in tiles of T columns
+    size_t stride = N - I;
+    size_t tiles = (stride + T - 1) / T;
+    band.resize((I1 - I) * stride);
+    std::atomic<size_t> next {0};
+    auto worker = [&](size_t t) {
+      auto wf = make_alg();
+      StageTimer timer(monitor ? &stats[t] : nullptr);
+      size_t pairs = 0;
+      for (size_t k = next++; k < tiles; k = next++) {
+	size_t J = I + k * T;
+	size_t J1 = std::min(N, J + T);
+	evaluate_tile(seqs, I, I1, J, J1, wf, band.data() + (J - I), stride);
+	for (size_t i = I; i < I1; ++i) {
+	  pairs += J1 - std::min(J1, std::max(J, i + 1));
+	}
+      }
+      timer.lap(DpStage);
+      if (monitor) {
+	stats[t].cells += computed_cells(wf, pairs, m);
+      }
+    };
+    if (threads == 1) {
+      worker(0);
     } else {
-      p2 = random_subsequence_position(genome, m, dist, rdev);
+      std::vector<std::thread> pool;
+      for (size_t t = 0; t < threads; ++t) {
+	pool.emplace_back(worker, t);
+      }
+      for (auto& th : pool) {
+	th.join();
+      }
+    }
+    main_timer.restart();
+    size_t pairs = 0;
+    for (size_t i = I; i < I1; ++i) {
+      writer.write_row(band.data() + (i - I) * stride + (i + 1 - I), N - 1 - i);
+      pairs += N - 1 - i;
+    }
+    main_timer.lap(OutputStage);
+    if (monitor) {
+      for (StageStats& st : stats) {
+	monitor->merge(st);
+	st = StageStats();
+      }
+      monitor->main_stats()->pairs += pairs;
+      monitor->emitted_pairs(pairs);
     }
-    out << p1.second << "," << p2.second << "," << wf(p1.first, p2.first) << "\n";
   }
+  writer.finish();
+  main_timer.lap(OutputStage);
 }
 
+/// \brief Runs the computation selected by 'opts' using the
+/// algorithms built by 'make_alg'. Returns the number of evaluated
+/// pairs.
+template <typename GenomeT_, typename AlgFactory_, typename WriterT_>
+size_t
+run(const Options& opts, const GenomeT_& genome, AlgFactory_ make_alg,
+    WriterT_& writer, RunMonitor* monitor)
+{
+  size_t m = opts.read_length;
+  size_t N = opts.read_count;
+  if (opts.sweep) {
+    size_t pairs = N * (opts.overlap_max - opts.overlap_min + 1);
+    if (monitor) {
+      monitor->set_expected(pairs);
+    }
+    compute_sweep(genome, m, N, opts.overlap_min, opts.overlap_max,
+		  opts.threads, opts.seed, make_alg, writer, monitor);
+    return pairs;
+  }
+  if (monitor) {
+    monitor->set_expected(N);
+  }
+  compute(genome, m, N, opts.read_overlap, opts.threads, opts.seed, make_alg,
+	  writer, monitor);
+  return N;
+}
 
-int
-main(int argc, char** argv)
+/// \brief Makes the writer selected by the 'output' option and runs
+/// the computation with it. With a 'monitor' the output goes through
+/// a counting buffer, so that the bytes written can be reported.
+template <typename GenomeT_, typename AlgFactory_>
+size_t
+run(const Options& opts, const GenomeT_& genome, AlgFactory_ make_alg,
+    RunMonitor* monitor)
 {
-  std::cerr << "\n";
+  OutputInfo info {opts.read_length, opts.read_count, opts.read_overlap,
+      opts.sweep, opts.overlap_min, opts.overlap_max, opts.threshold,
+      opts.seed, genome.size()};
+  std::unique_ptr<CountingStreamBuf> counter;
+  std::ostream counted {nullptr};
+  if (monitor) {
+    counter.reset(new CountingStreamBuf(std::cout.rdbuf()));
+    counted.rdbuf(counter.get());
+  }
+  std::ostream& out = monitor ? counted : std::cout;
+  size_t pairs = 0;
+  if (opts.all_vs_all) {
+    size_t N = opts.read_count;
+    pairs = N * (N - 1) / 2;
+    if (monitor) {
+      monitor->set_expected(pairs);
+    }
+    MatrixWriter<std::ostream> writer(out, info);
+    compute_all(genome, opts.read_length, N, opts.threads, opts.seed,
+		make_alg, writer, monitor);
+  } else if (opts.output == "binary") {
+    BinaryWriter<std::ostream> writer(out, info);
+    pairs = run(opts, genome, make_alg, writer, monitor);
+  } else if (opts.output == "stats" || opts.output == "histogram") {
+    StatsWriter<std::ostream> writer(out, info, opts.output == "histogram");
+    pairs = run(opts, genome, make_alg, writer, monitor);
+  } else {
+    CsvWriter<std::ostream> writer(out, info);
+    pairs = run(opts, genome, make_alg, writer, monitor);
+  }
+  if (monitor) {
+    counted.flush();
+    monitor->set_bytes_written(counter->bytes());
+  }
+  return pairs;
+}
 
-  Options opts(argc, argv);
-  if (opts.verbosity >= 2) {
-    opts.print(std::cerr);
+/// \brief Counts of each base in the genome.
+inline std::map<std::string, std::size_t>
+base_distribution(const std::string& genome)
+{
+  std::map<std::string, std::size_t> mm;
+  ctl::kmer_statistics(genome, 1, mm);
+  return mm;
+}
+
+inline std::map<std::string, std::size_t>
+base_distribution(const PackedGenome& genome)
+{
+  std::vector<std::size_t> counts(256, 0);
+  for (char c : genome) {
+    counts[static_cast<unsigned char>(c)]++;
   }
-  
-  // Initializations
-  btl::HeaderGenomePair hgp = btl::read_fasta(opts.fasta_path);
-  std::random_device rd;
-  auto rdev = std::mt19937(rd());
+  std::map<std::string, std::size_t> mm;
+  for (size_t c = 0; c < counts.size(); ++c) {
+    if (counts[c] > 0) {
+      mm[std::string(1, static_cast<char>(c))] = counts[c];
+    }
+  }
+  return mm;
+}
 
+/// \brief Runs ged on a loaded genome (either a std::string or a
+/// PackedGenome), 'load_seconds' is the time it took to load it.
+template <typename GenomeT_>
+void
+run_genome(const Options& opts, const GenomeT_& genome,
+	   const std::string& header, double load_seconds)
+{
   if (opts.verbosity >= 1) {
     // print some information on the input
-    std::cerr << "GENOME:  " << hgp.first << "\n"
-	      << "SIZE:    " << hgp.second.size() << "\n";
-    std::map<std::string, std::size_t> mm;
-    ctl::kmer_statistics(hgp.second, 1, mm);
+    std::cerr << "GENOME:  " << header << "\n"
+	      << "SIZE:    " << genome.size() << "\n";
+    std::map<std::string, std::size_t> mm = base_distribution(genome);
     std::cerr << "BASE DISTRIBUTION:\n";
     for (auto p : mm) {
       std::cerr << "        " << p.first << ": " << p.second << " "
-		<< (static_cast<double>(p.second) / hgp.second.size()) << "\n";
+		<< (static_cast<double>(p.second) / genome.size()) << "\n";
     }
     std::cerr << "\n";
   }
 
   // actual computation
   size_t m = opts.read_length;
-  size_t N = opts.read_count;
-  size_t s = opts.read_overlap;
-  auto wf = ctl::make_wf_alg(m,m);
-  compute(hgp.second, m, N, s, wf, rdev, std::cout);
+  size_t k = opts.threshold;
+  size_t pairs = 0;
+  // stage timers are only read when the summary or the progress lines
+  // are requested
+  std::unique_ptr<RunMonitor> monitor;
+  if (opts.verbosity >= 3 || opts.progress > 0) {
+    monitor.reset(new RunMonitor(std::cerr, opts.progress, load_seconds));
+  }
+  auto start = std::chrono::steady_clock::now();
+  if (k != NoThreshold) {
+    // thresholded mode always uses the banded algorithm
+    pairs = run(opts, genome, [k]() { return make_banded_alg(k); },
+		monitor.get());
+  } else if (opts.algorithm == "bitpar") {
+    pairs = run(opts, genome, [m]() { return make_bit_parallel_alg(m,m); },
+		monitor.get());
+  } else if (opts.algorithm == "simd") {
+    pairs = run(opts, genome, [m]() { return BatchedED(m,m); },
+		monitor.get());
+  } else {
+    pairs = run(opts, genome, [m]() { return ctl::make_wf_alg(m,m); },
+		monitor.get());
+  }
+  std::chrono::duration<double> elapsed =
+    std::chrono::steady_clock::now() - start;
+
+  if (opts.verbosity >= 1) {
+    // cells of the full DP matrix, regardless of the algorithm, so
+    // that different algorithms can be compared
+    double cells = static_cast<double>(pairs) * m * m;
+    std::cerr << "TIME:    " << elapsed.count() << " s\n"
+	      << "GCUPS:   " << cells / elapsed.count() / 1e9 << "\n";
+  }
+  if (opts.verbosity >= 3) {
+    std::string algorithm = (k != NoThreshold) ? "banded" : opts.algorithm;
+    monitor->write_json(std::cerr, genome.size(), m, opts.threads, algorithm);
+  }
+}
+
+int
+main(int argc, char** argv)
+{
+  std::cerr << "\n";
+
+  Options opts(argc, argv);
+  if (opts.verbosity >= 2) {
+    opts.print(std::cerr);
+  }
+  
+  // Initializations: packed genomes (see pack-genome) are mapped,
+  // fasta files are parsed
+  auto start = std::chrono::steady_clock::now();
+  if (is_packed_genome_path(opts.fasta_path)) {
+    PackedGenome genome = load_packed_genome(opts.fasta_path);
+    std::chrono::duration<double> load = std::chrono::steady_clock::now() - start;
+    run_genome(opts, genome, genome.header(), load.count());
+  } else {
+    btl::HeaderGenomePair hgp = btl::read_fasta(opts.fasta_path);
+    std::chrono::duration<double> load = std::chrono::steady_clock::now() - start;
+    run_genome(opts, hgp.second, hgp.first, load.count());
+  }
 
   std::cerr << "\n";
   
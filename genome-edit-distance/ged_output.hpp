@@ -0,0 +1,378 @@
+// ged_output.hpp
+
+// Copyright 2020 Michele Schimd
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RES_SW_GED_OUTPUT_HPP
+#define RES_SW_GED_OUTPUT_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+/// Result of the evaluation of a single pair of substrings.
+struct PairResult
+{
+  std::size_t position1;
+  std::size_t position2;
+  std::size_t distance;
+  std::size_t overlap;
+};
+
+/// Parameters of a run that writers put in headers (or use to format
+/// records).
+struct OutputInfo
+{
+  std::size_t n;
+  std::size_t N;
+  std::size_t s;
+  bool        sweep;
+  std::size_t s_min;
+  std::size_t s_max;
+  // std::numeric_limits<std::size_t>::max() when not thresholded
+  std::size_t k;
+  unsigned    seed;
+  std::size_t genome_size;
+
+  bool
+  thresholded() const
+  {
+    return k != std::numeric_limits<std::size_t>::max();
+  }
+};
+
+// All writers have the same interface:
+//   header()           called once before any result
+//   write(results)     called for each block of results, in order
+//   finish()           called once at the end
+
+/// One text line per pair (the original ged output).
+template <typename OutT_>
+class CsvWriter
+{
+private:
+  OutT_&     out;
+  OutputInfo info;
+
+public:
+  CsvWriter(OutT_& out_, const OutputInfo& info_) : out(out_), info(info_) { }
+
+  void
+  header()
+  {
+    out << (info.sweep ? "s,position1,position2,distance"
+	    : "position1,position2,distance");
+    out << (info.thresholded() ? ",censored\n" : "\n");
+  }
+
+  void
+  write(const std::vector<PairResult>& results)
+  {
+    for (const PairResult& p : results) {
+      if (info.sweep) {
+	out << p.overlap << ",";
+      }
+      out << p.position1 << "," << p.position2 << "," << p.distance;
+      if (info.thresholded()) {
+	out << "," << (p.distance > info.k ? 1 : 0);
+      }
+      out << "\n";
+    }
+  }
+
+  void finish() { }
+};
+
+/// Online aggregates of the distances for each overlap s: histogram,
+/// mean and variance (Welford's algorithm) and mean normalized by
+/// n. Nothing is written until finish(), which prints either the
+/// summary ("s,pairs,mean,variance,alpha") or the histogram
+/// ("s,distance,count") in long format.
+///
+/// With a threshold k the distances above k are only known to be
+/// larger than k: those pairs are counted apart and left out of the
+/// mean, variance and alpha (which are then over the pairs with
+/// distance at most k, counted in 'pairs'), and both formats get a
+/// 'censored' column. In the histogram the censored pairs are one row
+/// with distance k+1 and censored set to 1, as in the csv output.
+template <typename OutT_>
+class StatsWriter
+{
+private:
+  struct Aggregate
+  {
+    std::size_t              count = 0;
+    std::size_t              censored = 0;
+    double                   mean = 0;
+    double                   m2 = 0;
+    std::vector<std::size_t> histogram;
+  };
+
+  OutT_&                            out;
+  OutputInfo                        info;
+  bool                              histogram;
+  std::map<std::size_t, Aggregate>  aggregates;
+
+public:
+  StatsWriter(OutT_& out_, const OutputInfo& info_, bool histogram_)
+    : out(out_), info(info_), histogram(histogram_), aggregates() { }
+
+  void header() { }
+
+  void
+  write(const std::vector<PairResult>& results)
+  {
+    for (const PairResult& p : results) {
+      Aggregate& a = aggregates[p.overlap];
+      if (p.distance > info.k) {
+	a.censored++;
+	continue;
+      }
+      a.count++;
+      double delta = p.distance - a.mean;
+      a.mean += delta / a.count;
+      a.m2 += delta * (p.distance - a.mean);
+      if (a.histogram.size() <= p.distance) {
+	a.histogram.resize(p.distance + 1, 0);
+      }
+      a.histogram[p.distance]++;
+    }
+  }
+
+  void
+  finish()
+  {
+    const bool censoring = info.thresholded();
+    if (histogram) {
+      out << "s,distance,count" << (censoring ? ",censored\n" : "\n");
+      for (const auto& sa : aggregates) {
+	for (std::size_t d = 0; d < sa.second.histogram.size(); ++d) {
+	  if (sa.second.histogram[d] > 0) {
+	    out << sa.first << "," << d << "," << sa.second.histogram[d]
+		<< (censoring ? ",0\n" : "\n");
+	  }
+	}
+	if (sa.second.censored > 0) {
+	  out << sa.first << "," << info.k + 1 << "," << sa.second.censored
+	      << ",1\n";
+	}
+      }
+      return;
+    }
+    out << "s,pairs,mean,variance,alpha" << (censoring ? ",censored\n" : "\n");
+    for (const auto& sa : aggregates) {
+      const Aggregate& a = sa.second;
+      double var = (a.count > 1) ? a.m2 / (a.count - 1) : 0.0;
+      out << sa.first << "," << a.count << "," << a.mean << "," << var << ","
+	  << a.mean / info.n;
+      if (censoring) {
+	out << "," << a.censored;
+      }
+      out << "\n";
+    }
+  }
+};
+
+/// Magic bytes of the binary output
+constexpr char GedBinaryMagic[4] = {'G', 'E', 'D', 'B'};
+constexpr std::uint32_t GedBinaryVersion = 1;
+
+/// Fixed width binary records. The file starts with a 64 byte header
+/// (little endian, as written by the host):
+///
+///   char[4]  magic "GEDB"
+///   uint32   version
+///   uint64   n, N, s, s_min, s_max, k (UINT64_MAX if not thresholded)
+///   uint32   seed
+///   uint8    position width (4 or 8 bytes)
+///   uint8    distance width (2 or 4 bytes)
+///   uint8    sweep flag
+///   uint8    overlap width (2 or 4 bytes, 0 in plain mode)
+///
+/// Each record is position1 followed by position2 (plain mode) or by
+/// the overlap s (sweep mode, position2 = position1+n-s), then the
+/// distance.
+template <typename OutT_>
+class BinaryWriter
+{
+private:
+  OutT_&            out;
+  OutputInfo        info;
+  std::uint8_t      pos_width;
+  std::uint8_t      dist_width;
+  std::uint8_t      overlap_width;
+  std::vector<char> buffer;
+
+  template <typename T_>
+  void
+  put(T_ v)
+  {
+    char bytes[sizeof(T_)];
+    std::memcpy(bytes, &v, sizeof(T_));
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T_));
+  }
+
+  void
+  put_position(std::size_t p)
+  {
+    if (pos_width == 4) {
+      put(static_cast<std::uint32_t>(p));
+    } else {
+      put(static_cast<std::uint64_t>(p));
+    }
+  }
+
+public:
+  BinaryWriter(OutT_& out_, const OutputInfo& info_)
+    : out(out_), info(info_),
+      pos_width(info_.genome_size <= 0xFFFFFFFFull ? 4 : 8),
+      dist_width(2 * info_.n < 0xFFFF ? 2 : 4),
+      overlap_width(!info_.sweep ? 0 : (info_.n <= 0xFFFF ? 2 : 4)),
+      buffer() { }
+
+  void
+  header()
+  {
+    buffer.insert(buffer.end(), GedBinaryMagic, GedBinaryMagic + 4);
+    put(GedBinaryVersion);
+    put(static_cast<std::uint64_t>(info.n));
+    put(static_cast<std::uint64_t>(info.N));
+    put(static_cast<std::uint64_t>(info.s));
+    put(static_cast<std::uint64_t>(info.s_min));
+    put(static_cast<std::uint64_t>(info.s_max));
+    put(static_cast<std::uint64_t>(info.k));
+    put(static_cast<std::uint32_t>(info.seed));
+    put(pos_width);
+    put(dist_width);
+    put(static_cast<std::uint8_t>(info.sweep ? 1 : 0));
+    put(overlap_width);
+    out.write(buffer.data(), buffer.size());
+    buffer.clear();
+  }
+
+  void
+  write(const std::vector<PairResult>& results)
+  {
+    for (const PairResult& p : results) {
+      put_position(p.position1);
+      if (overlap_width == 2) {
+	put(static_cast<std::uint16_t>(p.overlap));
+      } else if (overlap_width == 4) {
+	put(static_cast<std::uint32_t>(p.overlap));
+      } else {
+	put_position(p.position2);
+      }
+      if (dist_width == 2) {
+	put(static_cast<std::uint16_t>(p.distance));
+      } else {
+	put(static_cast<std::uint32_t>(p.distance));
+      }
+    }
+    out.write(buffer.data(), buffer.size());
+    buffer.clear();
+  }
+
+  void finish() { out.flush(); }
+};
+
+/// Magic bytes of the all-vs-all matrix output
+constexpr char GedMatrixMagic[4] = {'G', 'E', 'D', 'M'};
+constexpr std::uint32_t GedMatrixVersion = 1;
+
+/// Condensed upper triangular matrix of the all-vs-all mode. The file
+/// starts with a 40 byte header (little endian, as written by the
+/// host):
+///
+///   char[4]  magic "GEDM"
+///   uint32   version
+///   uint64   n, N, k (UINT64_MAX if not thresholded)
+///   uint32   seed
+///   uint8    position width (4 or 8 bytes)
+///   uint8    distance width (2 or 4 bytes)
+///   uint8[2] padding
+///
+/// followed by the N positions of the substrings and by the N(N-1)/2
+/// distances d(i,j), i < j, in row major order (the condensed order of
+/// scipy's pdist). Rows are written as soon as they are complete.
+template <typename OutT_>
+class MatrixWriter
+{
+private:
+  OutT_&            out;
+  OutputInfo        info;
+  std::uint8_t      pos_width;
+  std::uint8_t      dist_width;
+  std::vector<char> buffer;
+
+  template <typename T_>
+  void
+  put(T_ v)
+  {
+    char bytes[sizeof(T_)];
+    std::memcpy(bytes, &v, sizeof(T_));
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T_));
+  }
+
+public:
+  MatrixWriter(OutT_& out_, const OutputInfo& info_)
+    : out(out_), info(info_),
+      pos_width(info_.genome_size <= 0xFFFFFFFFull ? 4 : 8),
+      dist_width(2 * info_.n < 0xFFFF ? 2 : 4), buffer() { }
+
+  void
+  header(const std::vector<std::size_t>& positions)
+  {
+    buffer.insert(buffer.end(), GedMatrixMagic, GedMatrixMagic + 4);
+    put(GedMatrixVersion);
+    put(static_cast<std::uint64_t>(info.n));
+    put(static_cast<std::uint64_t>(positions.size()));
+    put(static_cast<std::uint64_t>(info.k));
+    put(static_cast<std::uint32_t>(info.seed));
+    put(pos_width);
+    put(dist_width);
+    put(static_cast<std::uint16_t>(0));
+    for (std::size_t p : positions) {
+      if (pos_width == 4) {
+	put(static_cast<std::uint32_t>(p));
+      } else {
+	put(static_cast<std::uint64_t>(p));
+      }
+    }
+    out.write(buffer.data(), buffer.size());
+    buffer.clear();
+  }
+
+  /// Writes the 'count' distances of a row of the condensed matrix.
+  void
+  write_row(const std::uint32_t* d, std::size_t count)
+  {
+    for (std::size_t j = 0; j < count; ++j) {
+      if (dist_width == 2) {
+	put(static_cast<std::uint16_t>(d[j]));
+      } else {
+	put(d[j]);
+      }
+    }
+    out.write(buffer.data(), buffer.size());
+    buffer.clear();
+  }
+
+  void finish() { out.flush(); }
+};
+
+#endif
@@ -0,0 +1,256 @@
+// ged_stats.hpp
+
+// Copyright 2020 Michele Schimd
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RES_SW_GED_STATS_HPP
+#define RES_SW_GED_STATS_HPP
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+/// Stages of a ged run.
+enum GedStage
+{
+  LoadStage,    // fasta parsing or packed genome mapping
+  SampleStage,  // sampling of the positions and copy of the substrings
+  DpStage,      // edit distance computation
+  OutputStage,  // formatting and writing of the results
+  GedStageCount
+};
+
+constexpr const char* GedStageNames[GedStageCount] = {
+  "load", "sample", "dp", "output"
+};
+
+using StageClock = std::chrono::steady_clock;
+
+/// Time spent in each stage and work counters. Each worker thread has
+/// its own instance (no synchronization on the hot path), instances
+/// are merged at the end of every round.
+struct StageStats
+{
+  double        seconds[GedStageCount];
+  std::uint64_t pairs;
+  // DP cells actually computed (fewer than pairs*m*m for the banded
+  // algorithm)
+  std::uint64_t cells;
+
+  StageStats() : seconds(), pairs(0), cells(0) { }
+
+  void
+  merge(const StageStats& o)
+  {
+    for (int s = 0; s < GedStageCount; ++s) {
+      seconds[s] += o.seconds[s];
+    }
+    pairs += o.pairs;
+    cells += o.cells;
+  }
+};
+
+/// Charges the time elapsed since the previous lap (or construction)
+/// to a stage. With null stats the clock is never read, so the
+/// uninstrumented path only pays a branch.
+class StageTimer
+{
+private:
+  StageStats*            stats;
+  StageClock::time_point last;
+
+public:
+  explicit StageTimer(StageStats* stats_)
+    : stats(stats_), last(stats_ ? StageClock::now() : StageClock::time_point())
+  { }
+
+  void
+  lap(GedStage stage)
+  {
+    if (stats) {
+      StageClock::time_point now = StageClock::now();
+      stats->seconds[stage] += std::chrono::duration<double>(now - last).count();
+      last = now;
+    }
+  }
+
+  /// Starts a new lap without charging the elapsed time.
+  void
+  restart()
+  {
+    if (stats) {
+      last = StageClock::now();
+    }
+  }
+};
+
+/// Buffered stream buffer forwarding to 'sink' and counting the bytes
+/// written.
+class CountingStreamBuf : public std::streambuf
+{
+private:
+  std::streambuf*   sink;
+  std::vector<char> buffer;
+  std::uint64_t     flushed;
+
+  bool
+  drain()
+  {
+    std::streamsize n = pptr() - pbase();
+    if (n > 0 && sink->sputn(pbase(), n) != n) {
+      return false;
+    }
+    flushed += static_cast<std::uint64_t>(n);
+    setp(buffer.data(), buffer.data() + buffer.size());
+    return true;
+  }
+
+protected:
+  int_type
+  overflow(int_type c) override
+  {
+    if (!drain()) {
+      return traits_type::eof();
+    }
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+  int
+  sync() override
+  {
+    return (drain() && sink->pubsync() == 0) ? 0 : -1;
+  }
+
+public:
+  explicit CountingStreamBuf(std::streambuf* sink_, std::size_t size = 1 << 16)
+    : sink(sink_), buffer(size), flushed(0)
+  {
+    setp(buffer.data(), buffer.data() + buffer.size());
+  }
+
+  ~CountingStreamBuf() { drain(); }
+
+  std::uint64_t bytes() const { return flushed + (pptr() - pbase()); }
+};
+
+/// Peak resident set size of the process in KiB (0 if unavailable).
+inline std::uint64_t
+peak_rss_kib()
+{
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) != 0) {
+    return 0;
+  }
+#ifdef __APPLE__
+  return static_cast<std::uint64_t>(ru.ru_maxrss) / 1024;
+#else
+  return static_cast<std::uint64_t>(ru.ru_maxrss);
+#endif
+}
+
+/// Instrumentation of a run: collects the stage times and counters of
+/// the workers, prints progress lines every 'interval' seconds (0
+/// disables them) and the final JSON summary.
+class RunMonitor
+{
+private:
+  std::ostream&          log;
+  StageStats             total;
+  StageClock::time_point start;
+  StageClock::time_point last_progress;
+  double                 interval;
+  std::uint64_t          expected;
+  std::uint64_t          emitted;
+  std::uint64_t          bytes;
+
+  static double
+  since(StageClock::time_point t)
+  {
+    return std::chrono::duration<double>(StageClock::now() - t).count();
+  }
+
+public:
+  RunMonitor(std::ostream& log_, double interval_, double load_seconds)
+    : log(log_), total(), start(StageClock::now()), last_progress(start),
+      interval(interval_), expected(0), emitted(0), bytes(0)
+  {
+    total.seconds[LoadStage] = load_seconds;
+  }
+
+  /// Number of pairs the run will evaluate (for the progress lines).
+  void set_expected(std::uint64_t pairs) { expected = pairs; }
+
+  /// Stats of the main thread (output stage).
+  StageStats* main_stats() { return &total; }
+
+  void merge(const StageStats& worker) { total.merge(worker); }
+
+  /// Bytes of output written by the run.
+  void set_bytes_written(std::uint64_t b) { bytes = b; }
+
+  /// Called after 'pairs' results have been written.
+  void
+  emitted_pairs(std::uint64_t pairs)
+  {
+    emitted += pairs;
+    if (interval <= 0 || since(last_progress) < interval) {
+      return;
+    }
+    last_progress = StageClock::now();
+    double t = since(start);
+    double rate = emitted / t;
+    log << "PROGRESS: " << emitted << "/" << expected << " pairs ("
+	<< (expected > 0 ? 100.0 * emitted / expected : 0.0) << "%), "
+	<< t << " s, " << rate << " pairs/s, "
+	<< total.cells / t / 1e9 << " GCUPS, ETA "
+	<< (rate > 0 && expected > emitted ? (expected - emitted) / rate : 0.0)
+	<< " s\n";
+  }
+
+  /// Writes the summary of the run as one JSON object. Load and output
+  /// are wall-clock seconds of the main thread; sample and dp are
+  /// summed over the worker threads; wall_seconds does not include
+  /// the loading.
+  void
+  write_json(std::ostream& os, std::size_t genome_size, std::size_t m,
+	     std::size_t threads, const std::string& algorithm) const
+  {
+    double wall = since(start);
+    os << "{\"genome_size\": " << genome_size << ", \"m\": " << m
+       << ", \"threads\": " << threads
+       << ", \"algorithm\": \"" << algorithm << "\""
+       << ", \"pairs\": " << total.pairs << ", \"cells\": " << total.cells
+       << ", \"wall_seconds\": " << wall << ", \"stage_seconds\": {";
+    for (int s = 0; s < GedStageCount; ++s) {
+      os << (s > 0 ? ", " : "") << "\"" << GedStageNames[s] << "\": "
+	 << total.seconds[s];
+    }
+    os << "}, \"pairs_per_s\": " << total.pairs / wall
+       << ", \"gcups\": " << total.cells / wall / 1e9
+       << ", \"bytes_written\": " << bytes
+       << ", \"peak_rss_kib\": " << peak_rss_kib() << "}\n";
+  }
+};
+
+#endif
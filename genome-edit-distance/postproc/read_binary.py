@@ -0,0 +1,68 @@
+import sys
+import struct
+
+import numpy as np
+import pandas as pd
+
+# Reader for the binary output of ged (output=binary), see
+# ged_output.hpp for the layout.
+
+HEADER_FORMAT = "<4sI6QIBBBB"
+HEADER_SIZE = struct.calcsize(HEADER_FORMAT)
+
+
+def read_ged_binary(path):
+    with open(path, "rb") as f:
+        raw = f.read(HEADER_SIZE)
+        (magic, version, n, N, s, s_min, s_max, k, seed,
+         pos_width, dist_width, sweep, ov_width) = struct.unpack(HEADER_FORMAT, raw)
+        if magic != b"GEDB":
+            raise ValueError("Not a ged binary file: " + path)
+        pos_t = "<u4" if pos_width == 4 else "<u8"
+        dist_t = "<u2" if dist_width == 2 else "<u4"
+        # files written before the overlap width was recorded use 2 bytes
+        ov_t = "<u4" if ov_width == 4 else "<u2"
+        second = ("s", ov_t) if sweep else ("position2", pos_t)
+        rec = np.dtype([("position1", pos_t), second, ("distance", dist_t)])
+        data = np.fromfile(f, dtype=rec)
+    df = pd.DataFrame(data)
+    if sweep:
+        df["position2"] = df["position1"] + n - df["s"]
+    header = {"n": n, "N": N, "s": s, "s_min": s_min, "s_max": s_max,
+              "k": k, "seed": seed, "sweep": bool(sweep)}
+    return header, df
+
+
+MATRIX_HEADER_FORMAT = "<4sI3QIBBH"
+MATRIX_HEADER_SIZE = struct.calcsize(MATRIX_HEADER_FORMAT)
+
+
+def read_ged_matrix(path):
+    """All-vs-all output (all_vs_all=1): returns the header, the N
+    positions and the condensed distance matrix (scipy's squareform
+    turns it into the N x N matrix)."""
+    with open(path, "rb") as f:
+        raw = f.read(MATRIX_HEADER_SIZE)
+        (magic, version, n, N, k, seed,
+         pos_width, dist_width, _) = struct.unpack(MATRIX_HEADER_FORMAT, raw)
+        if magic != b"GEDM":
+            raise ValueError("Not a ged matrix file: " + path)
+        pos_t = "<u4" if pos_width == 4 else "<u8"
+        dist_t = "<u2" if dist_width == 2 else "<u4"
+        positions = np.fromfile(f, dtype=pos_t, count=N)
+        distances = np.fromfile(f, dtype=dist_t, count=N * (N - 1) // 2)
+    header = {"n": n, "N": N, "k": k, "seed": seed}
+    return header, positions, distances
+
+
+if (__name__ == "__main__"):
+    with open(sys.argv[1], "rb") as f:
+        magic = f.read(4)
+    if magic == b"GEDM":
+        header, positions, distances = read_ged_matrix(sys.argv[1])
+        print(header)
+        print(pd.Series(distances).describe())
+    else:
+        header, df = read_ged_binary(sys.argv[1])
+        print(header)
+        print(df.describe())
@@ -17,18 +17,156 @@
 
 #include <random>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdint>
 
 #include <btl/generator.hpp>
 #include <btl/io.hpp>
 
 #include <io/stream_map.hpp>
 
+#include <packed_genome.hpp>
+
+#include "stream_gen.hpp"
+#include "markov_model.hpp"
+
+/// Parses a distribution code (1: GC-Rich, 2: GC-Poor) or four comma
+/// separated weights.
+std::vector<double>
+parse_distribution(const std::string& str) {
+  std::vector<double> dist {1,1,1,1};
+  if (str.find(',') == std::string::npos) {
+    switch(ctl::from_string<int>(str)) {
+    case 1:
+      dist = {0.2, 0.3, 0.2, 0.3};
+      break;
+    case 2:
+      dist = {0.3, 0.2, 0.3, 0.2};
+      break;
+    default:
+      break;
+    }
+    return dist;
+  }
+  std::istringstream is(str);
+  std::string w;
+  for (size_t i = 0; i < 4 && std::getline(is, w, ','); ++i) {
+    dist[i] = ctl::from_string<double>(w);
+  }
+  return dist;
+}
+
+/// Streaming generation driven by a key=value configuration file,
+/// memory does not depend on G and chunks are generated in parallel.
+///
+///   G        number of bases (mandatory)
+///   dist     distribution code or weights pa,pc,pg,pt
+///   threads  generating threads (default 1)
+///   seed     seed of the counter-based generator (default random)
+///   line     bases per fasta line (default 80)
+///   chunk    bases per chunk (default 4M)
+///   model    'iid' (default) or 'markov'
+///   train    fasta (or packed) genome the markov model is trained on
+///   k        order of the markov model (default 3)
+int
+stream_main(const std::string& cfg_path) {
+  std::ifstream is {cfg_path};
+  auto kv_map = ctl::stream_to_map<std::string, std::string>(is,'=','#');
+  auto it_end = kv_map.end();
+  if (kv_map.find("G") == it_end) {
+    std::cerr << "Configuration file error (missing G)\n";
+    exit(1);
+  }
+  std::uint64_t G = ctl::from_string<std::uint64_t>(kv_map["G"]);
+  std::vector<double> dist {1,1,1,1};
+  if (kv_map.find("dist") != it_end) {
+    dist = parse_distribution(kv_map["dist"]);
+  }
+  size_t threads = 1;
+  if (kv_map.find("threads") != it_end) {
+    threads = ctl::from_string<size_t>(kv_map["threads"]);
+  }
+  std::uint64_t seed = std::random_device()();
+  if (kv_map.find("seed") != it_end) {
+    seed = ctl::from_string<std::uint64_t>(kv_map["seed"]);
+  }
+  size_t line = 80;
+  if (kv_map.find("line") != it_end) {
+    line = ctl::from_string<size_t>(kv_map["line"]);
+    if (line == 0) {
+      std::cerr << "Configuration file error (line must be positive)\n";
+      exit(1);
+    }
+  }
+  size_t chunk = size_t(1) << 22;
+  if (kv_map.find("chunk") != it_end) {
+    chunk = ctl::from_string<size_t>(kv_map["chunk"]);
+  }
+
+  std::string model {"iid"};
+  if (kv_map.find("model") != it_end) {
+    model = kv_map["model"];
+  }
+  std::ios_base::sync_with_stdio(false);
+
+  if (model == "markov") {
+    if (kv_map.find("train") == it_end) {
+      std::cerr << "Configuration file error (markov model requires train)\n";
+      exit(1);
+    }
+    std::string train = kv_map["train"];
+    size_t k = 3;
+    if (kv_map.find("k") != it_end) {
+      k = ctl::from_string<size_t>(kv_map["k"]);
+    }
+    if (k > MarkovBaseModel::MaxOrder) {
+      std::cerr << "Markov order must be at most " << MarkovBaseModel::MaxOrder
+		<< "\n";
+      exit(1);
+    }
+    std::string training;
+    if (is_packed_genome_path(train)) {
+      PackedGenome g = load_packed_genome(train);
+      training = g.substr(0, g.size());
+    } else {
+      training = btl::read_fasta(train).second;
+    }
+    MarkovBaseModel markov(training, k);
+    training.clear();
+    training.shrink_to_fit();
+    std::string header {"> markov genome"};
+    header += (" G=" + std::to_string(G));
+    header += " k=" + std::to_string(k) + " train=" + train;
+    header += " seed=" + std::to_string(seed);
+    stream_genome(std::cout, G, markov, seed, threads, chunk, line, header);
+    return 0;
+  }
+
+  std::string header {"> iid genome"};
+  header += (" G=" + std::to_string(G));
+  header += " dist=(";
+  for (auto w : dist) {
+    header += std::to_string(w) + ",";
+  }
+  header += ")";
+  header += " seed=" + std::to_string(seed);
+  stream_genome(std::cout, G, IidBaseModel(dist), seed, threads, chunk, line,
+		header);
+  return 0;
+}
+
 int
 main(int argc, char** argv) {
   if (argc < 2) {
     std::cerr << "Error in invocation\n";
     exit(1);
   }
+  // a single non numeric parameter is a configuration file
+  std::string first {argv[1]};
+  if (argc == 2 && first.find_first_not_of("0123456789") != std::string::npos) {
+    return stream_main(first);
+  }
   size_t G = ctl::from_string<size_t>(argv[1]);
   // by default the distribution is uniform on {A,C,G,T}
   std::vector<double> dist {1,1,1,1};
@@ -0,0 +1,200 @@
+// markov_model.hpp
+
+// Copyright 2020 Michele Schimd
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RES_SW_MARKOV_MODEL_HPP
+#define RES_SW_MARKOV_MODEL_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <str/kmer.hpp>
+
+#include "stream_gen.hpp"
+
+/// Builds Walker's alias table for the n weights 'w': outcome 'col'
+/// (uniform in [0,n)) is kept when the 32 bits uniform u < prob[col],
+/// otherwise alias[col] is returned.
+template <typename AliasT_>
+void
+build_alias_table(const double* w, std::size_t n, std::uint32_t* prob,
+		  AliasT_* alias)
+{
+  double tot = 0;
+  for (std::size_t i = 0; i < n; ++i) {
+    tot += w[i];
+  }
+  std::vector<double> scaled(n);
+  std::vector<std::size_t> small, large;
+  for (std::size_t i = 0; i < n; ++i) {
+    scaled[i] = w[i] * n / tot;
+    (scaled[i] < 1.0 ? small : large).push_back(i);
+  }
+  while (!small.empty() && !large.empty()) {
+    std::size_t s = small.back();
+    std::size_t l = large.back();
+    small.pop_back();
+    prob[s] = static_cast<std::uint32_t>(
+      std::min(scaled[s] * 4294967296.0, 4294967295.0));
+    alias[s] = static_cast<AliasT_>(l);
+    scaled[l] -= 1.0 - scaled[s];
+    if (scaled[l] < 1.0) {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+  // left overs have probability (numerically) 1
+  for (std::size_t i : small) {
+    prob[i] = 0xFFFFFFFFu;
+    alias[i] = static_cast<AliasT_>(i);
+  }
+  for (std::size_t i : large) {
+    prob[i] = 0xFFFFFFFFu;
+    alias[i] = static_cast<AliasT_>(i);
+  }
+}
+
+/// Alias table over an arbitrary number of outcomes, O(1) sampling.
+class AliasTable
+{
+private:
+  std::vector<std::uint32_t> prob;
+  std::vector<std::uint32_t> alias;
+
+public:
+  AliasTable() : prob(), alias() { }
+
+  explicit AliasTable(const std::vector<double>& w)
+    : prob(w.size()), alias(w.size())
+  {
+    build_alias_table(w.data(), w.size(), prob.data(), alias.data());
+  }
+
+  std::size_t size() const { return prob.size(); }
+
+  /// One 64 bits random value per sample: the high bits select the
+  /// column, the low 32 bits are compared with its threshold.
+  std::uint32_t
+  operator()(std::uint64_t r) const
+  {
+    std::size_t col = static_cast<std::size_t>((r >> 32) % prob.size());
+    return (static_cast<std::uint32_t>(r) < prob[col])
+      ? static_cast<std::uint32_t>(col) : alias[col];
+  }
+};
+
+/// Order-k Markov model of a genome: the distribution of each base
+/// depends on the k preceding bases (the context). Transition
+/// probabilities are estimated from the (k+1)-mer counts of a
+/// training genome (ctl::kmer_statistics, with add-one smoothing) and
+/// each context has its own 4 entries alias table, so generation is
+/// O(1) per base instead of a std::discrete_distribution search.
+///
+/// Contexts are encoded with 2 bits per base, most recent base in the
+/// lowest bits; the table of context c is at entries [4c, 4c+4).
+class MarkovBaseModel
+{
+private:
+  std::size_t                k;
+  std::uint64_t              ctx_mask;
+  std::vector<std::uint32_t> prob;
+  std::vector<std::uint8_t>  alias;
+  // distribution of the first k-mer of each chunk
+  AliasTable                 initial;
+
+  static int
+  code(char c)
+  {
+    switch (c) {
+    case 'A': case 'a': return 0;
+    case 'C': case 'c': return 1;
+    case 'G': case 'g': return 2;
+    case 'T': case 't': return 3;
+    default: return -1;
+    }
+  }
+
+public:
+  static constexpr std::size_t MaxOrder = 12;
+
+  /// Trains the model on 'genome', (k+1)-mers with symbols other than
+  /// ACGT are ignored.
+  MarkovBaseModel(const std::string& genome, std::size_t k_)
+    : k(k_), ctx_mask((std::uint64_t(1) << (2*k_)) - 1), prob(), alias(),
+      initial()
+  {
+    if (k > MaxOrder) {
+      throw std::invalid_argument("Markov order too large");
+    }
+    std::size_t contexts = std::size_t(1) << (2*k);
+    // (k+1)-mer with code c is context c/4 followed by base c%4
+    std::vector<double> counts(4*contexts, 1.0);
+    std::map<std::string, std::size_t> kmers;
+    ctl::kmer_statistics(genome, k+1, kmers);
+    for (const auto& p : kmers) {
+      std::uint64_t c = 0;
+      bool valid = true;
+      for (char ch : p.first) {
+	int b = code(ch);
+	if (b < 0) {
+	  valid = false;
+	  break;
+	}
+	c = (c << 2) | static_cast<std::uint64_t>(b);
+      }
+      if (valid) {
+	counts[c] += static_cast<double>(p.second);
+      }
+    }
+    prob.resize(4*contexts);
+    alias.resize(4*contexts);
+    std::vector<double> ctx_weight(contexts);
+    for (std::size_t ctx = 0; ctx < contexts; ++ctx) {
+      const double* w = &counts[4*ctx];
+      build_alias_table(w, 4, &prob[4*ctx], &alias[4*ctx]);
+      ctx_weight[ctx] = w[0] + w[1] + w[2] + w[3];
+    }
+    initial = AliasTable(ctx_weight);
+  }
+
+  std::size_t order() const { return k; }
+
+  /// Fills out[0,n) with a chunk of genome. Chunks are independent:
+  /// the first k bases of each chunk are drawn from the k-mer
+  /// distribution of the training genome, then the chain runs.
+  void
+  fill(char* out, std::size_t n, std::uint64_t, CounterRng& rng) const
+  {
+    std::uint64_t ctx = initial(rng());
+    std::size_t i = 0;
+    for (; i < k && i < n; ++i) {
+      out[i] = "ACGT"[(ctx >> (2*(k-1-i))) & 3];
+    }
+    for (; i < n; ++i) {
+      std::uint64_t r = rng();
+      std::size_t e = 4*ctx + (r >> 62);
+      std::uint64_t b = (static_cast<std::uint32_t>(r) < prob[e])
+	? (r >> 62) : alias[e];
+      out[i] = "ACGT"[b];
+      ctx = ((ctx << 2) | b) & ctx_mask;
+    }
+  }
+};
+
+#endif
@@ -0,0 +1,199 @@
+// stream_gen.hpp
+
+// Copyright 2020 Michele Schimd
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RES_SW_STREAM_GEN_HPP
+#define RES_SW_STREAM_GEN_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Streaming genome generation: the genome is produced in chunks of
+// fixed size by a pool of threads and written (line wrapped) in
+// order as soon as each chunk is complete. Only a bounded number of
+// chunks is kept in memory, regardless of the genome size.
+
+/// SplitMix64 finalizer, a bijective 64 bit mixing function.
+inline std::uint64_t
+mix64(std::uint64_t z)
+{
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+/// Counter-based random generator: the i-th value of stream 's' is
+/// mix64(key(seed, s) + i * gamma), therefore any chunk of the genome
+/// can be generated independently (and by any thread) and the output
+/// only depends on the seed. Satisfies UniformRandomBitGenerator, so
+/// it can be used with the <random> distributions.
+class CounterRng
+{
+private:
+  static constexpr std::uint64_t Gamma = 0x9e3779b97f4a7c15ULL;
+  std::uint64_t key;
+  std::uint64_t counter;
+
+public:
+  using result_type = std::uint64_t;
+
+  CounterRng(std::uint64_t seed, std::uint64_t stream)
+    : key(mix64(seed ^ mix64(stream * Gamma + Gamma))), counter(0) { }
+
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max()
+  {
+    return std::numeric_limits<result_type>::max();
+  }
+
+  result_type operator()() { return mix64(key + (++counter) * Gamma); }
+};
+
+/// i.i.d. bases with given weights for A, C, G, T. Each base uses 32
+/// random bits compared against the cumulative thresholds.
+class IidBaseModel
+{
+private:
+  std::uint64_t thresholds[3];
+
+public:
+  explicit IidBaseModel(const std::vector<double>& w)
+  {
+    double tot = w[0] + w[1] + w[2] + w[3];
+    double acc = 0;
+    for (std::size_t i = 0; i < 3; ++i) {
+      acc += w[i] / tot;
+      thresholds[i] = static_cast<std::uint64_t>(acc * 4294967296.0);
+    }
+  }
+
+  char
+  base(std::uint32_t u) const
+  {
+    return "ACGT"[(u >= thresholds[0]) + (u >= thresholds[1])
+		  + (u >= thresholds[2])];
+  }
+
+  /// Fills out[0,n) with i.i.d. bases (the chunk index is not used).
+  void
+  fill(char* out, std::size_t n, std::uint64_t, CounterRng& rng) const
+  {
+    std::size_t i = 0;
+    for (; i + 1 < n; i += 2) {
+      std::uint64_t r = rng();
+      out[i] = base(static_cast<std::uint32_t>(r));
+      out[i+1] = base(static_cast<std::uint32_t>(r >> 32));
+    }
+    if (i < n) {
+      out[i] = base(static_cast<std::uint32_t>(rng()));
+    }
+  }
+};
+
+/// \brief Generates G bases with 'model' and writes them as a fasta
+/// file on 'os'.
+///
+/// \param chunk bases per chunk, rounded to a multiple of 'line'.
+/// \param line bases per line of the fasta output.
+/// \param threads number of generating threads; at most 2*threads
+/// chunks are in memory at any time.
+///
+/// The model must have a member
+///   fill(char* out, size_t n, uint64_t chunk, CounterRng& rng)
+/// that writes n bases of chunk 'chunk' using 'rng', the random
+/// stream of that chunk.
+template <typename ModelT_>
+void
+stream_genome(std::ostream& os, std::uint64_t G, const ModelT_& model,
+	      std::uint64_t seed, std::size_t threads, std::size_t chunk,
+	      std::size_t line, const std::string& header)
+{
+  if (threads == 0) {
+    threads = 1;
+  }
+  chunk = std::max(line, chunk / line * line);
+  const std::uint64_t chunks = (G + chunk - 1) / chunk;
+  const std::size_t slots = 2 * threads;
+
+  // slot s holds chunk c (c % slots == s) when ready[s] == c+1
+  std::vector<std::string>   text(slots);
+  std::vector<std::uint64_t> ready(slots, 0);
+  std::vector<std::uint64_t> free_for(slots);
+  for (std::size_t s = 0; s < slots; ++s) {
+    free_for[s] = s;
+  }
+  std::mutex              mtx;
+  std::condition_variable cv;
+
+  auto worker = [&](std::size_t t) {
+    std::vector<char> bases(chunk);
+    for (std::uint64_t c = t; c < chunks; c += threads) {
+      std::size_t s = c % slots;
+      {
+	// wait until the writer released the slot for this chunk
+	std::unique_lock<std::mutex> lock(mtx);
+	cv.wait(lock, [&]() { return free_for[s] == c; });
+      }
+      std::size_t n = static_cast<std::size_t>(
+	std::min<std::uint64_t>(chunk, G - c * chunk));
+      CounterRng rng(seed, c);
+      model.fill(bases.data(), n, c, rng);
+      std::string& out = text[s];
+      out.clear();
+      for (std::size_t i = 0; i < n; i += line) {
+	std::size_t l = std::min(line, n - i);
+	out.append(bases.data() + i, l);
+	out.push_back('\n');
+      }
+      {
+	std::lock_guard<std::mutex> lock(mtx);
+	ready[s] = c + 1;
+      }
+      cv.notify_all();
+    }
+  };
+
+  os << header << "\n";
+  std::vector<std::thread> pool;
+  for (std::size_t t = 0; t < threads; ++t) {
+    pool.emplace_back(worker, t);
+  }
+  for (std::uint64_t c = 0; c < chunks; ++c) {
+    std::size_t s = c % slots;
+    {
+      std::unique_lock<std::mutex> lock(mtx);
+      cv.wait(lock, [&]() { return ready[s] == c + 1; });
+    }
+    os.write(text[s].data(), text[s].size());
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      free_for[s] = c + slots;
+    }
+    cv.notify_all();
+  }
+  for (auto& th : pool) {
+    th.join();
+  }
+  os.flush();
+}
+
+#endif
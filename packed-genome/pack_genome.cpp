@@ -0,0 +1,63 @@
+// pack_genome.cpp
+
+// Copyright 2020 Michele Schimd
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include <btl/io.hpp>
+
+#include <packed_genome.hpp>
+
+// Converts a fasta genome into the packed (2 bits per base) format
+// that ged, read-gen and genome-gen can map directly, or back to
+// fasta with -d.
+
+int
+main(int argc, char** argv)
+{
+  if (argc == 3 && std::string(argv[1]) == "-d") {
+    PackedGenome g = load_packed_genome(argv[2]);
+    std::string h = g.header();
+    std::cout << (h.empty() || h[0] != '>' ? ">" : "") << h << "\n";
+    const std::size_t line = 80;
+    std::string buf;
+    for (std::size_t i = 0; i < g.size(); i += line) {
+      std::size_t l = std::min(line, g.size() - i);
+      buf.resize(l);
+      g.extract(i, l, &buf[0]);
+      std::cout << buf << "\n";
+    }
+    return 0;
+  }
+  if (argc != 3) {
+    std::cerr << "Invalid usage\n  pack-genome genome.fasta genome.2bit\n"
+	      << "  pack-genome -d genome.2bit > genome.fasta\n";
+    std::exit(1);
+  }
+  btl::HeaderGenomePair hgp = btl::read_fasta(argv[1]);
+  PackedGenome g = PackedGenome::from_string(hgp.second, hgp.first);
+  try {
+    g.save(argv[2]);
+  } catch (const std::runtime_error& e) {
+    std::cerr << e.what() << "\n";
+    std::exit(1);
+  }
+  std::cerr << "Packed " << g.size() << " bases ("
+	    << g.masked_intervals() << " N intervals) in " << argv[2] << "\n";
+  return 0;
+}
@@ -0,0 +1,276 @@
+// bgzf.hpp
+
+// Copyright 2020 Michele Schimd
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RES_SW_BGZF_HPP
+#define RES_SW_BGZF_HPP
+
+#include <zlib.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Output stream buffer writing BGZF (the blocked gzip format of
+/// samtools/htslib): the data is cut in blocks of at most BlockSize
+/// bytes, each compressed as an independent gzip member carrying its
+/// compressed size in the 'BC' extra field. The result is a valid gzip
+/// file (readable by zcat/gunzip) that can also be decompressed in
+/// parallel or indexed.
+///
+/// Blocks are compressed by a pool of threads while the producer keeps
+/// writing; compressed blocks are written to the underlying stream in
+/// order by the producer thread. At most 2*threads blocks are in
+/// memory at any time.
+///
+///   BgzfStreamBuf buf(std::cout, 8);
+///   std::ostream os(&buf);
+///   os << ...;
+///   buf.close();
+class BgzfStreamBuf : public std::streambuf
+{
+public:
+  /// Uncompressed bytes per block, such that the compressed block
+  /// (stored if necessary) always fits the 16 bits BSIZE field.
+  static constexpr std::size_t BlockSize = 0xff00;
+
+private:
+  static constexpr std::size_t MaxBlock = 0x10000;
+  static constexpr std::size_t HeaderSize = 18;
+  static constexpr std::size_t FooterSize = 8;
+
+  enum class SlotState { Free, Pending, Running, Done };
+
+  struct Slot
+  {
+    std::string  data;
+    std::string  block;
+    SlotState    state;
+  };
+
+  std::ostream&            os;
+  int                      level;
+  std::vector<Slot>        slots;
+  std::vector<char>        buffer;
+  // next block to submit and next block to write
+  std::size_t              submitted;
+  std::size_t              written;
+  std::size_t              next_job;
+  bool                     closed;
+  bool                     stop;
+  std::mutex               mtx;
+  std::condition_variable  cv;
+  std::vector<std::thread> pool;
+
+  static void
+  put16(std::string& s, std::size_t p, std::uint32_t v)
+  {
+    s[p] = static_cast<char>(v & 0xff);
+    s[p+1] = static_cast<char>((v >> 8) & 0xff);
+  }
+
+  static void
+  put32(std::string& s, std::size_t p, std::uint32_t v)
+  {
+    put16(s, p, v & 0xffff);
+    put16(s, p+2, v >> 16);
+  }
+
+  /// Compresses 'data' as a single BGZF block in 'block'.
+  static void
+  compress_block(const std::string& data, int level, std::string& block)
+  {
+    block.assign(MaxBlock, '\0');
+    for (int l : {level, 0}) {
+      z_stream zs;
+      zs.zalloc = Z_NULL;
+      zs.zfree = Z_NULL;
+      zs.opaque = Z_NULL;
+      // raw deflate, the gzip header is written below
+      if (deflateInit2(&zs, l, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+	throw std::runtime_error("BGZF: deflateInit2 failed");
+      }
+      zs.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+      zs.avail_in = static_cast<uInt>(data.size());
+      zs.next_out = reinterpret_cast<Bytef*>(&block[HeaderSize]);
+      zs.avail_out = static_cast<uInt>(MaxBlock - HeaderSize - FooterSize);
+      int ret = deflate(&zs, Z_FINISH);
+      std::size_t clen = zs.total_out;
+      deflateEnd(&zs);
+      if (ret != Z_STREAM_END) {
+	// did not fit: store the block uncompressed
+	continue;
+      }
+      std::size_t bsize = HeaderSize + clen + FooterSize;
+      const unsigned char header[HeaderSize] = {
+	0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0, 0, 0 };
+      block.replace(0, HeaderSize, reinterpret_cast<const char*>(header),
+		    HeaderSize);
+      put16(block, 16, static_cast<std::uint32_t>(bsize - 1));
+      uLong crc = crc32(0L, Z_NULL, 0);
+      crc = crc32(crc, reinterpret_cast<const Bytef*>(data.data()),
+		  static_cast<uInt>(data.size()));
+      put32(block, HeaderSize + clen, static_cast<std::uint32_t>(crc));
+      put32(block, HeaderSize + clen + 4,
+	    static_cast<std::uint32_t>(data.size()));
+      block.resize(bsize);
+      return;
+    }
+    throw std::runtime_error("BGZF: block does not fit");
+  }
+
+  void
+  worker()
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (true) {
+      cv.wait(lock, [&]() {
+	  return stop || (next_job < submitted &&
+			  slots[next_job % slots.size()].state == SlotState::Pending);
+	});
+      if (next_job >= submitted) {
+	return;
+      }
+      Slot& slot = slots[next_job % slots.size()];
+      ++next_job;
+      slot.state = SlotState::Running;
+      lock.unlock();
+      compress_block(slot.data, level, slot.block);
+      lock.lock();
+      slot.state = SlotState::Done;
+      cv.notify_all();
+    }
+  }
+
+  /// Writes the compressed blocks up to (excluded) 'until', waiting
+  /// for their compression to complete.
+  void
+  write_blocks(std::size_t until)
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (written < until) {
+      Slot& slot = slots[written % slots.size()];
+      cv.wait(lock, [&]() { return slot.state == SlotState::Done; });
+      lock.unlock();
+      os.write(slot.block.data(), slot.block.size());
+      lock.lock();
+      slot.state = SlotState::Free;
+      ++written;
+    }
+  }
+
+  /// Hands the put area to the compressors.
+  void
+  submit()
+  {
+    std::size_t n = static_cast<std::size_t>(pptr() - pbase());
+    if (n == 0) {
+      return;
+    }
+    if (submitted - written == slots.size()) {
+      // all slots busy: write the oldest block
+      write_blocks(written + 1);
+    }
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      Slot& slot = slots[submitted % slots.size()];
+      slot.data.assign(pbase(), n);
+      slot.state = SlotState::Pending;
+      ++submitted;
+    }
+    cv.notify_all();
+    setp(buffer.data(), buffer.data() + buffer.size());
+    // write whatever is already compressed
+    std::unique_lock<std::mutex> lock(mtx);
+    while (written < submitted &&
+	   slots[written % slots.size()].state == SlotState::Done) {
+      lock.unlock();
+      write_blocks(written + 1);
+      lock.lock();
+    }
+  }
+
+protected:
+  int_type
+  overflow(int_type c) override
+  {
+    submit();
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+      *pptr() = traits_type::to_char_type(c);
+      pbump(1);
+    }
+    return traits_type::not_eof(c);
+  }
+
+  int
+  sync() override
+  {
+    // blocks are only cut when full, so sync only pushes the data
+    // already compressed
+    os.flush();
+    return os ? 0 : -1;
+  }
+
+public:
+  BgzfStreamBuf(std::ostream& os_, std::size_t threads, int level_ = 6)
+    : os(os_), level(level_), slots(2 * std::max<std::size_t>(1, threads)),
+      buffer(BlockSize), submitted(0), written(0), next_job(0),
+      closed(false), stop(false)
+  {
+    setp(buffer.data(), buffer.data() + buffer.size());
+    for (std::size_t t = 0; t < std::max<std::size_t>(1, threads); ++t) {
+      pool.emplace_back(&BgzfStreamBuf::worker, this);
+    }
+  }
+
+  BgzfStreamBuf(const BgzfStreamBuf&) = delete;
+  BgzfStreamBuf& operator=(const BgzfStreamBuf&) = delete;
+
+  ~BgzfStreamBuf() { close(); }
+
+  /// Compresses and writes the remaining data followed by the BGZF
+  /// end-of-file block.
+  void
+  close()
+  {
+    if (closed) {
+      return;
+    }
+    closed = true;
+    submit();
+    write_blocks(submitted);
+    {
+      std::lock_guard<std::mutex> lock(mtx);
+      stop = true;
+    }
+    cv.notify_all();
+    for (auto& th : pool) {
+      th.join();
+    }
+    const unsigned char eof[28] = {
+      0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0, 0x1b, 0,
+      3, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+    os.write(reinterpret_cast<const char*>(eof), sizeof(eof));
+    os.flush();
+  }
+};
+
+#endif
@@ -16,62 +16,30 @@
 
 #include <random>
 #include <iostream>
+#include <fstream>
+#include <cstdint>
 
 #include <io/stream_map.hpp>
 
 #include <btl/io.hpp>
 
+#include <packed_genome.hpp>
+
+#include "bgzf.hpp"
+#include "read_sim.hpp"
+
 // TODOs
 // - Length distribution 
-// - Parameter file
-// - Distribution of errors as input parameter
-// - Quality values
-// - Edit script in verbose mode
 
 template <typename StrT, typename IterT, typename RandD>
 StrT
 edit_error(IterT b, IterT e, std::vector<double> p, RandD& rd) {
-  p.push_back(1.0 - p[0] - p[1] - p[2]);
-  std::string op_str = "SDIM";  
-  std::map<char, std::string> subs_map = {
-    {'A', "CGT"},
-    {'C', "AGT"},
-    {'G', "ACT"},
-    {'T', "ACG"},
-    {'*', "ACGT"}
-  };
-
-  std::discrete_distribution<int> op_dist(p.begin(), p.end());
-  std::uniform_int_distribution<int> sub_dist(0,2);
-  std::uniform_int_distribution<int> ins_dist(0,3);
-
-  // TODO: keep track of the script to put on verbose out
-  StrT out;
-  while (b != e) {
-    auto c = *b;
-    char op = op_str[op_dist(rd)];
-    switch(op) {
-    case 'M':
-      out.push_back(c);
-      ++b;
-      break;
-    case 'S':
-      out.push_back(subs_map[c][sub_dist(rd)]);
-      ++b;
-      break;
-    case 'I':
-      out.push_back(subs_map['*'][ins_dist(rd)]);
-      ++b;
-      break;
-    case 'D':
-      ++b;
-      break;
-    default:
-      ++b;
-      break;
-    }
-  }
-  return out;
+  // the model works on 64 bits random values
+  std::mt19937_64 rd64(rd());
+  ErrorModel model(p);
+  std::string out;
+  model.apply(b, e, out, rd64);
+  return StrT(out.begin(), out.end());
 }
 
 template <typename RandD>
@@ -86,64 +54,141 @@ string_edit_error(const std::string& r, std::vector<double> pe, RandD& rd) {
   return edit_error<std::string, decltype(r.begin()), RandD>(r.cbegin(), r.cend(), pe, rd);
 }
 
+/// Error probabilities (substitution, deletion, insertion) of the
+/// error codes: 1 hamming, 2 edit.
+std::vector<double>
+error_probabilities(int error) {
+  switch (error) {
+  case 1:
+    return {0.1, 0.0, 0.0};
+  case 2:
+    return {0.1, 0.05, 0.05};
+  default:
+    return {0.0, 0.0, 0.0};
+  }
+}
+
+template <typename MapT>
+std::string
+get_or(MapT& kv_map, const std::string& key, const std::string& def) {
+  return (kv_map.find(key) != kv_map.end()) ? kv_map[key] : def;
+}
+
+/// Reads whitespace separated per position error probabilities.
+std::vector<double>
+read_error_profile(const std::string& path) {
+  std::ifstream is {path};
+  if (!is) {
+    std::cerr << "Cannot open error profile " << path << "\n";
+    std::exit(1);
+  }
+  std::vector<double> profile;
+  double p;
+  while (is >> p) {
+    profile.push_back(p);
+  }
+  return profile;
+}
+
+struct OutputOptions {
+  // bgzf compressed output
+  bool   compress;
+  size_t threads;
+  int    level;
+};
+
+template <typename GenomeT>
+void
+write_reads(const GenomeT& genome, const ReadSimOptions& opts,
+	    const OutputOptions& out) {
+  if (!out.compress) {
+    simulate_reads(genome, opts, std::cout);
+    return;
+  }
+  BgzfStreamBuf buf(std::cout, out.threads, out.level);
+  std::ostream os(&buf);
+  simulate_reads(genome, opts, os);
+  buf.close();
+}
+
 int
 main(int argc, char** argv)
 {
 
+  std::string gen_file;
+  ReadSimOptions opts {0, 0, ErrorModel(), 1, std::random_device()(),
+      4096, false, false};
+  OutputOptions out {false, 1, 6};
+  std::vector<double> p {0.0, 0.0, 0.0};
+  std::vector<double> profile;
+
   // If only a parameter is given, it must be the configuration file
   if (argc == 2) {
-    
+    std::ifstream is {argv[1]};
+    auto kv_map = ctl::stream_to_map<std::string, std::string>(is,'=','#');
+    if (kv_map.find("genome") == kv_map.end() ||
+	kv_map.find("N") == kv_map.end() || kv_map.find("L") == kv_map.end()) {
+      std::cerr << "Configuration file error (genome, N and L required)\n";
+      std::exit(1);
+    }
+    gen_file = kv_map["genome"];
+    opts.reads = ctl::from_string<size_t>(kv_map["N"]);
+    opts.length = ctl::from_string<size_t>(kv_map["L"]);
+    p = error_probabilities(ctl::from_string<int>(get_or(kv_map, "error", "0")));
+    p[0] = ctl::from_string<double>(get_or(kv_map, "p_sub", std::to_string(p[0])));
+    p[1] = ctl::from_string<double>(get_or(kv_map, "p_del", std::to_string(p[1])));
+    p[2] = ctl::from_string<double>(get_or(kv_map, "p_ins", std::to_string(p[2])));
+    opts.model = ErrorModel(p);
+    opts.threads = ctl::from_string<size_t>(get_or(kv_map, "threads", "1"));
+    if (kv_map.find("seed") != kv_map.end()) {
+      opts.seed = ctl::from_string<std::uint64_t>(kv_map["seed"]);
+    }
+    opts.batch = ctl::from_string<size_t>(get_or(kv_map, "batch", "4096"));
+    opts.verbose = ctl::from_string<int>(get_or(kv_map, "verbose", "0")) != 0;
+    std::string format = get_or(kv_map, "format", "fasta");
+    if (format != "fasta" && format != "fastq") {
+      std::cerr << "Unknown format " << format << " (fasta|fastq)\n";
+      std::exit(1);
+    }
+    opts.fastq = (format == "fastq");
+    if (kv_map.find("error_profile") != kv_map.end()) {
+      profile = read_error_profile(kv_map["error_profile"]);
+    }
+    out.compress = ctl::from_string<int>(get_or(kv_map, "compress", "0")) != 0;
+    out.threads = ctl::from_string<size_t>(
+      get_or(kv_map, "compress_threads", std::to_string(opts.threads)));
+    out.level = ctl::from_string<int>(get_or(kv_map, "level", "6"));
+  } else {
+    if (argc < 4) {
+      std::cerr << "Invalid usage\n  read-gen G N L [Err]\n  read-gen config\n";
+      std::exit(1);
+    }
+    gen_file = argv[1];
+    opts.reads = ctl::from_string<size_t>(argv[2]);
+    // TODO: add support for distribution of lengths
+    opts.length = ctl::from_string<size_t>(argv[3]);
+    if (argc == 5) {
+      p = error_probabilities(ctl::from_string<int>(argv[4]));
+      opts.model = ErrorModel(p);
+    }
   }
-  
-  if (argc < 4) {
-    std::cerr << "Invalid usage\n  read-gen G N L [Err]\n";
-    std::exit(1);
+  if (opts.batch == 0) {
+    opts.batch = 1;
   }
-
-  std::string gen_file { argv[1] };
-  size_t N = ctl::from_string<size_t>(argv[2]);
-  // TODO: add support for distribution of lengths
-  size_t L = ctl::from_string<size_t>(argv[3]);
-  size_t Lmax = L;
-
-  int error = 0; // No error
-  bool circular = true;
-  int pos = 0;
-
-  bool verbose_out = false;
-  
-  if (argc == 5) {
-    error = ctl::from_string<int>(argv[4]);
+  if (!profile.empty()) {
+    // the profile gives the error rate of each position (and so the
+    // qualities), p only the mix of the operations
+    opts.model = ErrorModel(p, profile);
   }
 
-  // load the fasta file
-  auto genome = btl::read_fasta(gen_file);
-  size_t G = genome.second.size();
-  // augment the genome with Lmax to emulate 'circularity'
-  genome.second.insert(genome.second.end(), genome.second.begin(), genome.second.begin() + Lmax);
-
-  std::random_device rd;
-  std::default_random_engine rdev(rd());
-  std::uniform_int_distribution<int> pdist(0,G-1);
-
-  for (size_t i = 0; i < N; ++i) {
-    size_t j = pdist(rdev);
-    size_t Lj = L;
-    std::string r {genome.second.begin() + j, genome.second.begin()+j+Lj};
-    std::string ver_h = (verbose_out) ? (" (" + r + ") ") : "";
-    std::cout << ">id=" << i << " j=" << j << ver_h << "\n";
-    // Error
-    switch (error) {
-    case 1: // hamming error
-      r = string_hamming_error(r, 0.1, rd);
-      break;
-    case 2: // edit error
-      r = string_edit_error(r, {0.1, 0.05, 0.05}, rd);
-      break;
-    default:
-      break;
-    }
-    std::cout << r << "\n";
+  std::ios_base::sync_with_stdio(false);
+  // reads wrap around the end of the genome to emulate 'circularity'
+  if (is_packed_genome_path(gen_file)) {
+    PackedGenome genome = load_packed_genome(gen_file);
+    write_reads(genome, opts, out);
+  } else {
+    auto genome = btl::read_fasta(gen_file);
+    write_reads(genome.second, opts, out);
   }
   
   return 0;
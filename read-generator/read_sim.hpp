@@ -0,0 +1,391 @@
+// read_sim.hpp
+
+// Copyright 2020 Michele Schimd
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RES_SW_READ_SIM_HPP
+#define RES_SW_READ_SIM_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Run length encoded edit script of a read w.r.t. the genome, in
+/// extended CIGAR notation: '=' match, 'X' substitution, 'I' base
+/// inserted in the read, 'D' genome base deleted from the read.
+class EditScript
+{
+private:
+  std::string* out;
+  char         last;
+  std::size_t  count;
+
+public:
+  /// The script is written in 'o' (nothing is recorded if null).
+  explicit EditScript(std::string* o) : out(o), last(0), count(0)
+  {
+    if (out != nullptr) {
+      out->clear();
+    }
+  }
+
+  void
+  add(char op, std::size_t n)
+  {
+    if (out == nullptr || n == 0) {
+      return;
+    }
+    if (op != last) {
+      finish();
+      last = op;
+    }
+    count += n;
+  }
+
+  void
+  finish()
+  {
+    if (out != nullptr && count > 0) {
+      *out += std::to_string(count);
+      out->push_back(last);
+    }
+    count = 0;
+  }
+};
+
+/// Phred+33 quality string of the per position error probabilities
+/// 'profile', extended to 'length' positions with its last value.
+inline std::string
+quality_string(const std::vector<double>& profile, std::size_t length)
+{
+  std::string q;
+  for (std::size_t i = 0; i < length; ++i) {
+    double p = profile.empty() ? 0.0 : profile[std::min(i, profile.size()-1)];
+    // Phred scores are capped to 41 (error probability < 1e-4.1)
+    double phred = (p > 0) ? std::round(-10.0 * std::log10(p)) : 41.0;
+    q.push_back(static_cast<char>(33 + std::min(std::max(phred, 0.0), 41.0)));
+  }
+  return q;
+}
+
+/// Per base error model: each base of the read is substituted (pS),
+/// deleted (pD), preceded by an inserted random base (pI) or copied
+/// (1-pS-pD-pI).
+///
+/// Instead of drawing an operation for every base, the number of
+/// error-free bases before the next error is drawn from a geometric
+/// distribution with parameter pS+pD+pI and copied in bulk; the
+/// operation is then chosen with probabilities proportional to pS, pD
+/// and pI. This is the same distribution as the per base model, but
+/// costs O(errors) random values per read. The 64 bit random value of
+/// an error selects the operation (low 32 bits) and the substituted or
+/// inserted symbol (high bits).
+///
+/// With an error profile the error probability depends on the position
+/// in the read (the last value is used past the end of the profile),
+/// while pS, pD and pI only give the mix of the operations. Gaps are
+/// drawn with the largest probability of the profile and an error at
+/// position i is kept with probability profile[i] / max (thinning), so
+/// the errors follow the profile at the cost of one more random value
+/// per candidate error.
+///
+/// The model also gives the Phred+33 quality of each base it outputs:
+/// the one of the profile at the position the base comes from (or of
+/// pS+pD+pI without a profile), so the qualities match the errors.
+class ErrorModel
+{
+private:
+  double                     p_err;
+  // conditional (given an error) cumulative thresholds
+  std::uint32_t              th_sub;
+  std::uint32_t              th_del;
+  // subs[3*c + r] is the r-th symbol that can replace c
+  char                       subs[3*256];
+  // per position probability that a candidate error is kept (empty
+  // without a profile)
+  std::vector<std::uint32_t> keep;
+  // per position quality (the last one for the remaining positions)
+  std::string                phred;
+
+  static std::uint32_t
+  threshold(double p)
+  {
+    return static_cast<std::uint32_t>(
+      std::min(std::max(p, 0.0) * 4294967296.0, 4294967295.0));
+  }
+
+  static double
+  profile_max(const std::vector<double>& profile)
+  {
+    double m = 0;
+    for (double q : profile) {
+      m = std::max(m, q);
+    }
+    return std::min(m, 1.0);
+  }
+
+  std::uint32_t
+  keep_at(std::size_t i) const
+  {
+    return keep[std::min(i, keep.size() - 1)];
+  }
+
+  char
+  phred_at(std::size_t i) const
+  {
+    return phred[std::min(i, phred.size() - 1)];
+  }
+
+  void
+  add_quality(std::string* quality, std::size_t i, std::size_t n) const
+  {
+    if (quality != nullptr) {
+      for (std::size_t k = i; k < i + n; ++k) {
+	quality->push_back(phred_at(k));
+      }
+    }
+  }
+
+public:
+  /// 'p' holds the probabilities of substitution, deletion and
+  /// insertion (in this order), the rest is the probability of match.
+  explicit ErrorModel(const std::vector<double>& p = {0.0, 0.0, 0.0})
+    : ErrorModel(p, std::vector<double>())
+  { }
+
+  /// Errors at position i of the read happen with probability
+  /// profile[i] (if not empty), 'p' gives the mix of substitutions,
+  /// deletions and insertions (substitutions only if all 0).
+  ErrorModel(const std::vector<double>& p, const std::vector<double>& profile)
+    : p_err(profile.empty() ? std::min(p[0] + p[1] + p[2], 1.0)
+	    : profile_max(profile)),
+      th_sub(0), th_del(0), keep(), phred()
+  {
+    double mix = p[0] + p[1] + p[2];
+    if (mix > 0) {
+      th_sub = threshold(p[0] / mix);
+      th_del = threshold((p[0] + p[1]) / mix);
+    } else {
+      th_sub = th_del = threshold(1.0);
+    }
+    if (!profile.empty() && p_err > 0) {
+      for (double q : profile) {
+	keep.push_back(threshold(std::max(q, 0.0) / p_err));
+      }
+    }
+    phred = quality_string(profile.empty() ? std::vector<double>{p_err}
+			   : profile, std::max<std::size_t>(1, profile.size()));
+    // symbols other than ACGT (any case) are not changed by substitutions
+    for (std::size_t c = 0; c < 256; ++c) {
+      for (std::size_t r = 0; r < 3; ++r) {
+	subs[3*c + r] = static_cast<char>(c);
+      }
+    }
+    const std::string bases = "ACGT";
+    for (char c : bases) {
+      std::string others;
+      for (char o : bases) {
+	if (o != c) {
+	  others.push_back(o);
+	}
+      }
+      std::copy(others.begin(), others.end(),
+		subs + 3*static_cast<unsigned char>(c));
+      std::copy(others.begin(), others.end(),
+		subs + 3*static_cast<unsigned char>(c - 'A' + 'a'));
+    }
+  }
+
+  bool error_free() const { return p_err <= 0; }
+
+  /// Appends to 'out' the sequence [b,e) (random access iterators)
+  /// with errors; if 'script' is not null the applied edits are
+  /// written there (see EditScript), if 'quality' is not null the
+  /// quality of each base appended to 'out' is appended there.
+  template <typename It_, typename RandD_>
+  void
+  apply(It_ b, It_ e, std::string& out, RandD_& rd,
+	std::string* script = nullptr, std::string* quality = nullptr) const
+  {
+    EditScript ops(script);
+    std::size_t n = static_cast<std::size_t>(e - b);
+    if (error_free()) {
+      out.append(b, e);
+      add_quality(quality, 0, n);
+      ops.add('=', n);
+      ops.finish();
+      return;
+    }
+    // geometric_distribution requires p < 1
+    std::geometric_distribution<std::size_t> gap(p_err < 1.0 ? p_err : 0.5);
+    std::size_t i = 0;
+    while (i < n) {
+      // bases before the next error
+      std::size_t g = (p_err < 1.0) ? std::min(gap(rd), n - i) : 0;
+      out.append(b + i, b + i + g);
+      add_quality(quality, i, g);
+      ops.add('=', g);
+      i += g;
+      if (i == n) {
+	break;
+      }
+      std::uint64_t r = rd();
+      if (!keep.empty()) {
+	// thinning: the candidate error is kept with profile[i] / p_err
+	if (static_cast<std::uint32_t>(r) >= keep_at(i)) {
+	  out.push_back(b[i]);
+	  add_quality(quality, i, 1);
+	  ops.add('=', 1);
+	  ++i;
+	  continue;
+	}
+	r = rd();
+      }
+      std::uint32_t u = static_cast<std::uint32_t>(r);
+      std::uint32_t v = static_cast<std::uint32_t>(r >> 32);
+      if (u < th_sub) {
+	out.push_back(subs[3*static_cast<unsigned char>(b[i]) + v % 3]);
+	add_quality(quality, i, 1);
+	ops.add('X', 1);
+      } else if (u < th_del) {
+	ops.add('D', 1);
+      } else {
+	out.push_back("ACGT"[v & 3]);
+	out.push_back(b[i]);
+	add_quality(quality, i, 2);
+	ops.add('I', 1);
+	ops.add('=', 1);
+      }
+      ++i;
+    }
+    ops.finish();
+  }
+
+};
+
+/// Copies [j, j+L) of a circular genome ('genome' may be a
+/// std::string or a PackedGenome) in 'r'.
+template <typename GenomeT_>
+void
+circular_substring(const GenomeT_& genome, std::size_t j, std::size_t L,
+		   std::string& r)
+{
+  std::size_t G = genome.size();
+  r.clear();
+  r.append(genome.begin() + j, genome.begin() + j + std::min(L, G - j));
+  while (r.size() < L) {
+    std::size_t l = std::min(L - r.size(), G);
+    r.append(genome.begin(), genome.begin() + l);
+  }
+}
+
+struct ReadSimOptions
+{
+  std::size_t   reads;
+  std::size_t   length;
+  ErrorModel    model;
+  std::size_t   threads;
+  std::uint64_t seed;
+  // reads generated with the same random stream
+  std::size_t   batch;
+  bool          verbose;
+  // fastq output (qualities given by the error model)
+  bool          fastq;
+};
+
+/// \brief Generates the reads of batch 'b' and appends them (fasta or
+/// fastq formatted) to 'text'. The batch has its own generator seeded with
+/// (seed, b), so the output does not depend on the number of threads.
+template <typename GenomeT_>
+void
+generate_batch(const GenomeT_& genome, const ReadSimOptions& o,
+	       std::size_t b, std::string& text)
+{
+  std::seed_seq seq {static_cast<std::uint32_t>(o.seed),
+      static_cast<std::uint32_t>(o.seed >> 32),
+      static_cast<std::uint32_t>(b), static_cast<std::uint32_t>(b >> 32)};
+  std::mt19937_64 rd(seq);
+  std::uniform_int_distribution<std::size_t> pdist(0, genome.size()-1);
+  std::size_t first = b * o.batch;
+  std::size_t last = std::min(o.reads, first + o.batch);
+  text.clear();
+  std::string r, e, script, quality;
+  for (std::size_t i = first; i < last; ++i) {
+    std::size_t j = pdist(rd);
+    circular_substring(genome, j, o.length, r);
+    e.clear();
+    quality.clear();
+    o.model.apply(r.begin(), r.end(), e, rd,
+		  o.verbose ? &script : nullptr, o.fastq ? &quality : nullptr);
+    text += o.fastq ? "@id=" : ">id=";
+    text += std::to_string(i);
+    text += " j=";
+    text += std::to_string(j);
+    if (o.verbose) {
+      text += " cigar=" + script + " (" + r + ") ";
+    }
+    text += "\n";
+    text += e;
+    text += "\n";
+    if (o.fastq) {
+      text += "+\n";
+      text += quality;
+      text += "\n";
+    }
+  }
+}
+
+/// \brief Generates o.reads reads of 'genome' on o.threads threads
+/// and writes them on 'os' in id order. Batches are generated in
+/// rounds of 4*threads and each one is written with a single call.
+template <typename GenomeT_>
+void
+simulate_reads(const GenomeT_& genome, const ReadSimOptions& o,
+	       std::ostream& os)
+{
+  std::size_t threads = std::max<std::size_t>(1, o.threads);
+  std::size_t batches = (o.reads + o.batch - 1) / o.batch;
+  std::size_t round = 4 * threads;
+  std::vector<std::string> text(round);
+  for (std::size_t r = 0; r < batches; r += round) {
+    std::size_t round_batches = std::min(round, batches - r);
+    auto worker = [&](std::size_t t) {
+      for (std::size_t b = t; b < round_batches; b += threads) {
+	generate_batch(genome, o, r + b, text[b]);
+      }
+    };
+    if (threads == 1) {
+      worker(0);
+    } else {
+      std::vector<std::thread> pool;
+      for (std::size_t t = 0; t < threads; ++t) {
+	pool.emplace_back(worker, t);
+      }
+      for (auto& th : pool) {
+	th.join();
+      }
+    }
+    for (std::size_t b = 0; b < round_batches; ++b) {
+      os.write(text[b].data(), text[b].size());
+    }
+  }
+  os.flush();
+}
+
+#endif
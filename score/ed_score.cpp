@@ -14,71 +14,163 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <cstdlib>
 #include <string>
-#include <list>
 #include <iostream>
+#include <fstream>
+#include <vector>
 
-#include <str/distance.hpp>
-
-
-template <typename ListT>
-std::pair<std::string, std::string>
-align_from_script(const std::string& x, const std::string& y, const ListT& l) {
-  size_t i = 0;
-  size_t j = 0;
-  std::string xa;
-  std::string ya;
-  for (auto p : l) {
-    size_t ip = p.first;
-    size_t jp = p.second;
-    char cx = ' ';
-    if (ip-i > 0) {
-      cx = x[ip-1];
+#include <io/stream_map.hpp>
+
+#include <bit_parallel_ed.hpp>
+#include <banded_ed.hpp>
+#include <hirschberg.hpp>
+
+#include "overlap_dp.hpp"
+
+
+void
+usage() {
+  std::cerr << "Usage:\n\ted-score [k]\n"
+	    << "\ted-score -b reads.fa [pairs|all] [min_overlap]\n";
+  exit(1);
+}
+
+/// Prints, for every prefix of y, the suffix of x at minimum distance;
+/// distances above k are reported as k+1 and marked as censored (as
+/// the banded distance and ged do).
+void
+print_overlaps(const std::string& x, const std::string& y,
+	       const std::vector<Overlap>& ov, size_t k) {
+  for (Overlap o : ov) {
+    bool censored = (o.distance > k);
+    if (censored) {
+      o.distance = k + 1;
+    }
+    std::cout << x.substr(o.origin) << "  " << y.substr(0, o.y_len) << "\t"
+	      << o.distance << "\t" << o.score();
+    if (censored) {
+      std::cout << "\tcensored";
+    }
+    std::cout << "\n";
+  }
+}
+
+/// Scores the overlaps of the pairs of reads in 'pairs_file' (one
+/// pair of 0-based indexes per line, all pairs if empty), in both
+/// orientations, reporting the overlap of minimum score among those at
+/// least 'min_len' long.
+int
+batch_main(const std::string& reads_file, const std::string& pairs_file,
+	   size_t min_len) {
+  auto reads = read_fasta_records(reads_file);
+  std::vector<std::pair<size_t, size_t>> pairs;
+  if (pairs_file.empty()) {
+    for (size_t i = 0; i < reads.size(); ++i) {
+      for (size_t j = i+1; j < reads.size(); ++j) {
+	pairs.emplace_back(i, j);
+      }
+    }
+  } else {
+    std::ifstream is {pairs_file};
+    size_t i, j;
+    while (is >> i >> j) {
+      if (i >= reads.size() || j >= reads.size()) {
+	std::cerr << "Invalid pair " << i << " " << j << "\n";
+	return 1;
+      }
+      pairs.emplace_back(i, j);
     }
-    char cy = ' ';
-    if (jp-j > 0) {
-      cy = y[jp-1];
+  }
+  OverlapAligner ov;
+  std::cout << "i,j,orientation,origin,x_len,y_len,distance,score\n";
+  for (auto p : pairs) {
+    const std::string& a = reads[p.first].second;
+    const std::string& b = reads[p.second].second;
+    // suffix of i / prefix of j, then suffix of j / prefix of i
+    for (int orientation = 0; orientation < 2; ++orientation) {
+      Overlap o = ov.best(orientation == 0 ? a : b, orientation == 0 ? b : a,
+			  min_len);
+      if (o.y_len == 0) {
+	continue;
+      }
+      std::cout << p.first << "," << p.second << ","
+		<< (orientation == 0 ? "ij" : "ji") << "," << o.origin << ","
+		<< o.x_len << "," << o.y_len << "," << o.distance << ","
+		<< o.score() << "\n";
     }
-    xa = xa + cx;
-    ya = ya + cy;
-    i = ip;
-    j = jp;    
   }
-  return std::make_pair(xa,ya);
+  return 0;
 }
 
 int
 main(int argc, char** argv)
 {
+  // ed-score -b reads.fa [pairs] [min_overlap]
+  if (argc >= 2 && std::string(argv[1]) == "-b") {
+    if (argc < 3) {
+      usage();
+    }
+    std::string pairs_file = (argc >= 4 && std::string(argv[3]) != "all")
+      ? argv[3] : "";
+    size_t min_len = (argc >= 5) ? ctl::from_string<size_t>(argv[4]) : 10;
+    return batch_main(argv[2], pairs_file, min_len);
+  }
+
   std::string x {"AGCTACCGTGAACTGGT"};  
   std::string y {"TACCGTAAAGCTAATTGTAA"};
 
   //std::string x {"TACGT"};  
   //std::string y {"ACGTA"};
   
+  // optional threshold: overlaps with distance above k are censored
+  size_t k = NoThreshold;
+  if (argc >= 2) {
+    if (argv[1][0] == '-') {
+      usage();
+    }
+    k = ctl::from_string<size_t>(argv[1]);
+  }
+
   size_t n = x.size();
   size_t m = y.size();
-  auto ed = ctl::make_wf_alg<size_t>(n,m);
+  // only distances are needed for the overlaps; with a threshold the
+  // banded DP costs O(k*m) and stops as soon as the distance exceeds k
+  auto bp = make_bit_parallel_alg(n,m);
+  auto bd = make_banded_alg(k == NoThreshold ? 0 : k);
 
-  // make all possible overlaps x/y
+  // all the overlaps x[i,n) / y[0,n-i), read in place
   for (size_t i = 0; i < n-1; ++i) {
-    std::string x1 = x.substr(i,n-i);
-    std::string y2 = y.substr(0,std::min(n-i,m));
-    std::cout << x1 << "  " << y2 << "\t" << ed(x1,y2) / (double)(x1.size()+y2.size()) << "\n";
+    size_t l = std::min(n-i,m);
+    size_t d;
+    if (k == NoThreshold) {
+      bp.set_pattern(x.begin() + i, x.end());
+      d = bp.distance(y.begin(), y.begin() + l);
+    } else {
+      d = bd.distance(x.begin() + i, x.end(), y.begin(), y.begin() + l);
+    }
+    std::cout.write(x.data() + i, n-i) << "  ";
+    std::cout.write(y.data(), l) << "\t" << d / (double)(n-i+l);
+    if (k != NoThreshold && bd.censored(d)) {
+      std::cout << "\tcensored";
+    }
+    std::cout << "\n";
   }
 
-  using ListPair = std::list<std::pair<size_t,size_t>>;
-
-  ed(x,y);
-  auto l = ed.backtrack<ListPair>();
-  for (auto p : l) {
-    std::cout << "(" << p.first << "," << p.second << ")\n";
-  }
-  auto pp = align_from_script<ListPair>(x,y,l);
+  // linear space alignment, rendered only for printing
+  HirschbergAligner aligner;
+  Cigar cigar;
+  size_t d = aligner(x, y, cigar);
+  std::cout << cigar_string(cigar) << "\t" << d << "\n";
+  auto pp = render_alignment(x, y, cigar);
   std::cout << pp.first << "\n" << pp.second << "\n";
 
-  // make all poassible overlaps y/x
-  
+  // best suffix of x (y) for every prefix of y (x), single DP each
+  OverlapAligner ov;
+  std::cout << "overlaps x/y\n";
+  print_overlaps(x, y, ov(x, y), k);
+  std::cout << "overlaps y/x\n";
+  print_overlaps(y, x, ov(y, x), k);
 
   return 0;
 }
@@ -0,0 +1,238 @@
+// overlap_dp.hpp
+
+// Copyright 2020 Michele Schimd
+
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+
+//     http://www.apache.org/licenses/LICENSE-2.0
+
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef RES_SW_OVERLAP_DP_HPP
+#define RES_SW_OVERLAP_DP_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/// Overlap of a suffix of x, x[origin, n), with the prefix y[0, y_len).
+struct Overlap
+{
+  std::size_t origin;
+  std::size_t x_len;
+  std::size_t y_len;
+  std::size_t distance;
+
+  /// Edit distance normalized by the total length of the overlap.
+  double
+  score() const
+  {
+    return distance / static_cast<double>(x_len + y_len);
+  }
+};
+
+/// Semi-global (overlap) edit distance: for every prefix y[0, l) the
+/// suffix of x at minimum edit distance, all from a single O(n*m) DP.
+///
+/// The DP is the usual edit distance DP except that the alignment may
+/// start at any row (D(i,0) = 0), and each cell carries the row where
+/// its best alignment started (the origin), so D(n,l) with its origin
+/// gives the best suffix of x for the prefix of length l. Only one row
+/// of distances and origins is kept; an instance reuses its buffers.
+class OverlapAligner
+{
+private:
+  std::vector<std::size_t>  dist;
+  std::vector<std::size_t>  origin;
+  std::vector<std::int64_t> cost;
+
+  /// Overlap with y_len >= min_len minimizing L*distance -
+  /// d*(x_len+y_len); 'found' is false if that minimum is not negative
+  /// (no overlap scores less than d/L).
+  Overlap
+  improve(const std::string& x, const std::string& y, std::size_t min_len,
+	  std::int64_t d, std::int64_t L, bool& found)
+  {
+    const std::size_t n = x.size();
+    const std::size_t m = y.size();
+    // every symbol in the overlap costs -d, every edit L more
+    const std::int64_t match = -2*d;
+    const std::int64_t subst = L - 2*d;
+    const std::int64_t gap = L - d;
+    cost.resize(m+1);
+    dist.resize(m+1);
+    origin.resize(m+1);
+    for (std::size_t j = 0; j < m+1; ++j) {
+      cost[j] = static_cast<std::int64_t>(j) * gap;
+      dist[j] = j;
+      origin[j] = 0;
+    }
+    for (std::size_t i = 1; i < n+1; ++i) {
+      std::int64_t diag = cost[0];
+      std::size_t diag_d = dist[0];
+      std::size_t diag_o = origin[0];
+      cost[0] = 0;
+      dist[0] = 0;
+      origin[0] = i;
+      const char cx = x[i-1];
+      for (std::size_t j = 1; j < m+1; ++j) {
+	std::int64_t up = cost[j];
+	std::size_t up_d = dist[j];
+	std::size_t up_o = origin[j];
+	bool eq = (cx == y[j-1]);
+	std::int64_t c = diag + (eq ? match : subst);
+	std::size_t e = diag_d + (eq ? 0 : 1);
+	std::size_t o = diag_o;
+	if (up + gap < c) {
+	  c = up + gap;
+	  e = up_d + 1;
+	  o = up_o;
+	}
+	if (cost[j-1] + gap < c) {
+	  c = cost[j-1] + gap;
+	  e = dist[j-1] + 1;
+	  o = origin[j-1];
+	}
+	diag = up;
+	diag_d = up_d;
+	diag_o = up_o;
+	cost[j] = c;
+	dist[j] = e;
+	origin[j] = o;
+      }
+    }
+    found = false;
+    Overlap best {0, 0, 0, 0};
+    std::int64_t best_cost = 0;
+    for (std::size_t l = std::max<std::size_t>(min_len, 1); l < m+1; ++l) {
+      if (cost[l] < best_cost) {
+	best_cost = cost[l];
+	best = Overlap{origin[l], n - origin[l], l, dist[l]};
+	found = true;
+      }
+    }
+    return best;
+  }
+
+public:
+  /// out[l-1] is the suffix of x at minimum edit distance from y[0,l)
+  /// for l = 1..|y| (not necessarily the one of minimum score, see
+  /// best()).
+  void
+  operator()(const std::string& x, const std::string& y,
+	     std::vector<Overlap>& out)
+  {
+    const std::size_t n = x.size();
+    const std::size_t m = y.size();
+    dist.resize(m+1);
+    origin.resize(m+1);
+    // row 0: the suffix starting at 0, only insertions
+    for (std::size_t j = 0; j < m+1; ++j) {
+      dist[j] = j;
+      origin[j] = 0;
+    }
+    for (std::size_t i = 1; i < n+1; ++i) {
+      // (i,0) starts a new alignment at row i
+      std::size_t diag = dist[0];
+      std::size_t diag_o = origin[0];
+      dist[0] = 0;
+      origin[0] = i;
+      const char cx = x[i-1];
+      for (std::size_t j = 1; j < m+1; ++j) {
+	std::size_t up = dist[j];
+	std::size_t up_o = origin[j];
+	// ties are broken towards the longest suffix (smaller origin)
+	std::size_t d = diag + (cx == y[j-1] ? 0 : 1);
+	std::size_t o = diag_o;
+	if (up + 1 < d || (up + 1 == d && up_o < o)) {
+	  d = up + 1;
+	  o = up_o;
+	}
+	if (dist[j-1] + 1 < d || (dist[j-1] + 1 == d && origin[j-1] < o)) {
+	  d = dist[j-1] + 1;
+	  o = origin[j-1];
+	}
+	diag = up;
+	diag_o = up_o;
+	dist[j] = d;
+	origin[j] = o;
+      }
+    }
+    out.resize(m);
+    for (std::size_t l = 1; l < m+1; ++l) {
+      out[l-1] = Overlap{origin[l], n - origin[l], l, dist[l]};
+    }
+  }
+
+  std::vector<Overlap>
+  operator()(const std::string& x, const std::string& y)
+  {
+    std::vector<Overlap> out;
+    (*this)(x, y, out);
+    return out;
+  }
+
+  /// Overlap of minimum score among all the suffixes of x and the
+  /// prefixes of y at least min_len long (y_len is 0 if there are
+  /// none). The score is a ratio, so it is minimized with Dinkelbach's
+  /// method: starting from the best of the minimum distance overlaps,
+  /// with score d/L, a DP finds the overlap minimizing
+  /// L*distance - d*(x_len+y_len); while that is negative the overlap
+  /// scores less than d/L and becomes the next candidate. Each step is
+  /// one O(n*m) DP and only a few are needed.
+  Overlap
+  best(const std::string& x, const std::string& y, std::size_t min_len)
+  {
+    std::vector<Overlap> out;
+    (*this)(x, y, out);
+    Overlap cand {0, 0, 0, 0};
+    for (const Overlap& o : out) {
+      if (o.y_len >= min_len && (cand.y_len == 0 || o.score() < cand.score())) {
+	cand = o;
+      }
+    }
+    bool found = (cand.y_len > 0);
+    while (found) {
+      Overlap o = improve(x, y, min_len,
+			  static_cast<std::int64_t>(cand.distance),
+			  static_cast<std::int64_t>(cand.x_len + cand.y_len),
+			  found);
+      if (found) {
+	cand = o;
+      }
+    }
+    return cand;
+  }
+};
+
+/// Reads all the records (header, sequence) of a fasta file.
+inline std::vector<std::pair<std::string, std::string>>
+read_fasta_records(const std::string& path)
+{
+  std::vector<std::pair<std::string, std::string>> records;
+  std::ifstream is {path};
+  std::string line;
+  while (std::getline(is, line)) {
+    if (!line.empty() && line.back() == '\r') {
+      line.pop_back();
+    }
+    if (!line.empty() && line[0] == '>') {
+      records.emplace_back(line, "");
+    } else if (!records.empty()) {
+      records.back().second += line;
+    }
+  }
+  return records;
+}
+
+#endif